@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "../common/simd.hpp"
+
+// up to four cascaded biquads in transposed direct form II, run on four
+// channels at once: channel c lives in lane c % 4 of register group c / 4.
+// all channels share the coefficients, every channel keeps its own state.
+// a single channel would leave three lanes idle, so it runs the sections in
+// the lanes instead: section k works on the sample k steps behind section 0
+// and its output moves up one lane for the next step.
+// the number of live sections is a template argument of the inner loop,
+// picked once per block, so there is no per-section bypass test per sample.
+class BiquadCascade
+{
+public:
+    static constexpr int max_sections = 4;
+
+    // not the audio thread
+    void prepare(int num_channels, int max_block)
+    {
+        mono = num_channels == 1;
+        groups = std::max(1, (num_channels + 3) / 4);
+        block = std::max(1, max_block);
+        z1.assign(groups * max_sections, f4::set(0.f));
+        z2.assign(groups * max_sections, f4::set(0.f));
+        scratch.assign(block, f4::set(0.f));
+    }
+
+    void reset()
+    {
+        std::fill(z1.begin(), z1.end(), f4::set(0.f));
+        std::fill(z2.begin(), z2.end(), f4::set(0.f));
+        std::fill(lane_z1, lane_z1 + 4, 0.f);
+        std::fill(lane_z2, lane_z2 + 4, 0.f);
+    }
+
+    // coefficients normalized to a0 = 1
+    void set_section(int k, float b0, float b1, float b2, float a1, float a2)
+    {
+        this->b0[k] = f4::set(b0);
+        this->b1[k] = f4::set(b1);
+        this->b2[k] = f4::set(b2);
+        this->a1[k] = f4::set(a1);
+        this->a2[k] = f4::set(a2);
+        lane_b0[k] = b0;
+        lane_b1[k] = b1;
+        lane_b2[k] = b2;
+        lane_a1[k] = a1;
+        lane_a2[k] = a2;
+    }
+
+    // sections [0, count) run; ones that come back on start from silence
+    void set_num_sections(int count)
+    {
+        count = std::min(std::max(count, 0), max_sections);
+        for (int g = 0; g < groups; g++)
+        {
+            for (int k = sections; k < count; k++)
+            {
+                z1[g * max_sections + k] = f4::set(0.f);
+                z2[g * max_sections + k] = f4::set(0.f);
+            }
+        }
+        for (int k = sections; k < count; k++)
+            lane_z1[k] = lane_z2[k] = 0.f;
+        sections = count;
+    }
+
+    int num_sections() const
+    {
+        return sections;
+    }
+
+    // filters channels[0, num_channels) in place
+    void process(float *const *channels, int num_channels, int num_samples)
+    {
+        if (mono && num_channels == 1)
+        {
+            switch (sections)
+            {
+            case 1:
+                run_mono<1>(channels[0], num_samples);
+                break;
+            case 2:
+                run_mono<2>(channels[0], num_samples);
+                break;
+            case 3:
+                run_mono<3>(channels[0], num_samples);
+                break;
+            case 4:
+                run_mono<4>(channels[0], num_samples);
+                break;
+            default:
+                break;
+            }
+            return;
+        }
+
+        switch (sections)
+        {
+        case 1:
+            run<1>(channels, num_channels, num_samples);
+            break;
+        case 2:
+            run<2>(channels, num_channels, num_samples);
+            break;
+        case 3:
+            run<3>(channels, num_channels, num_samples);
+            break;
+        case 4:
+            run<4>(channels, num_channels, num_samples);
+            break;
+        default:
+            break;
+        }
+    }
+
+private:
+    f4 b0[max_sections], b1[max_sections], b2[max_sections], a1[max_sections], a2[max_sections];
+    int sections = 0;
+    int groups = 1;
+    int block = 1;
+    std::vector<f4> z1, z2;   // state, groups * max_sections
+    std::vector<f4> scratch; // one block of four interleaved channels
+
+    // the single channel layout: lane k is section k, unused lanes have zero coefficients
+    bool mono = false;
+    alignas(16) float lane_b0[4] = {}, lane_b1[4] = {}, lane_b2[4] = {}, lane_a1[4] = {}, lane_a2[4] = {};
+    alignas(16) float lane_z1[4] = {}, lane_z2[4] = {};
+
+    // section k on its own, the same arithmetic one lane of the vector step does
+    float step(int k, float v)
+    {
+        float y = lane_b0[k] * v + lane_z1[k];
+        lane_z1[k] = lane_b1[k] * v - lane_a1[k] * y + lane_z2[k];
+        lane_z2[k] = lane_b2[k] * v - lane_a2[k] * y;
+        return y;
+    }
+
+    // every section sees its samples in order, so the result is bit-identical
+    // to running the sections one after the other. the first Sections - 1
+    // samples fill the pipeline and the last Sections - 1 drain it one section
+    // at a time, in between one vector step moves every section on by a sample
+    template <int Sections>
+    void run_mono(float *x, int n)
+    {
+        if (n < Sections)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                float v = x[j];
+                for (int k = 0; k < Sections; k++)
+                    v = step(k, v);
+                x[j] = v;
+            }
+            return;
+        }
+
+        // fill: after sample t, section k has seen samples up to t - k and
+        // pending[k + 1] is its output waiting for section k + 1
+        alignas(16) float pending[4] = {};
+        for (int t = 0; t < Sections - 1; t++)
+        {
+            alignas(16) float next[4] = {};
+            for (int k = 0; k <= t; k++)
+                next[k + 1] = step(k, k == 0 ? x[t] : pending[k]);
+            std::copy(next, next + 4, pending);
+        }
+
+        const f4 vb0 = f4::load(lane_b0), vb1 = f4::load(lane_b1), vb2 = f4::load(lane_b2);
+        const f4 va1 = f4::load(lane_a1), va2 = f4::load(lane_a2);
+        f4 s1 = f4::load(lane_z1), s2 = f4::load(lane_z2);
+        pending[0] = x[Sections - 1];
+        f4 v = f4::load(pending);
+        alignas(16) float out[4];
+        for (int t = Sections - 1; t < n; t++)
+        {
+            f4 y = vb0 * v + s1;
+            s1 = vb1 * v - va1 * y + s2;
+            s2 = vb2 * v - va2 * y;
+            // the last section finished sample t - (Sections - 1), which is already read
+            y.store(out);
+            x[t - (Sections - 1)] = out[Sections - 1];
+            v = shift_in(y, t + 1 < n ? x[t + 1] : 0.f);
+        }
+        s1.store(lane_z1);
+        s2.store(lane_z2);
+
+        // drain: sample j has been through sections [0, n - j), out[k] is section k's last output
+        for (int j = n - Sections + 1; j < n; j++)
+        {
+            float w = out[n - 1 - j];
+            for (int k = n - j; k < Sections; k++)
+                w = step(k, w);
+            x[j] = w;
+        }
+    }
+
+    template <int Sections>
+    void run(float *const *channels, int num_channels, int num_samples)
+    {
+        float *x = reinterpret_cast<float *>(scratch.data());
+        for (int g = 0; g < groups && 4 * g < num_channels; g++)
+        {
+            const int lanes = std::min(4, num_channels - 4 * g);
+            float *const *group = channels + 4 * g;
+
+            f4 s1[Sections], s2[Sections];
+            for (int k = 0; k < Sections; k++)
+            {
+                s1[k] = z1[g * max_sections + k];
+                s2[k] = z2[g * max_sections + k];
+            }
+
+            for (int start = 0; start < num_samples; start += block)
+            {
+                const int n = std::min(block, num_samples - start);
+
+                // interleave, the missing channels of the last group are silent lanes
+                for (int j = 0; j < n; j++)
+                    for (int l = 0; l < 4; l++)
+                        x[4 * j + l] = l < lanes ? group[l][start + j] : 0.f;
+
+                for (int j = 0; j < n; j++)
+                {
+                    f4 v = f4::load(x + 4 * j);
+                    for (int k = 0; k < Sections; k++)
+                    {
+                        f4 y = b0[k] * v + s1[k];
+                        s1[k] = b1[k] * v - a1[k] * y + s2[k];
+                        s2[k] = b2[k] * v - a2[k] * y;
+                        v = y;
+                    }
+                    v.store(x + 4 * j);
+                }
+
+                for (int l = 0; l < lanes; l++)
+                    for (int j = 0; j < n; j++)
+                        group[l][start + j] = x[4 * j + l];
+            }
+
+            for (int k = 0; k < Sections; k++)
+            {
+                z1[g * max_sections + k] = s1[k];
+                z2[g * max_sections + k] = s2[k];
+            }
+        }
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include "plugin_processor.hpp"
+
+inline bool operator==(const ChainSettings &a, const ChainSettings &b)
+{
+    return a.lowCutFreq == b.lowCutFreq && a.highCutFreq == b.highCutFreq &&
+           a.lowCutSlope == b.lowCutSlope && a.highCutSlope == b.highCutSlope &&
+           a.lowCutBypassed == b.lowCutBypassed && a.highCutBypassed == b.highCutBypassed;
+}
+
+inline bool operator!=(const ChainSettings &a, const ChainSettings &b)
+{
+    return !(a == b);
+}
+
+// one complete design of the cut filters, built off the audio thread
+struct CoefficientSet
+{
+    ChainSettings settings;
+    juce::ReferenceCountedArray<juce::dsp::IIR::Coefficients<float>> lowCut, highCut;
+};
+
+// designs the Butterworth cut filters on a background thread and hands them to
+// the audio thread with an atomic pointer swap.
+// the worker polls the settings and only designs when they changed. the audio
+// thread just exchanges a pointer and copies the section coefficients into the
+// cut filters, so it neither designs nor allocates or frees anything.
+// once replaced a set goes back through `trash` and the worker deletes it.
+class CoefficientManager
+{
+public:
+    ~CoefficientManager()
+    {
+        stop();
+        delete pending.exchange(nullptr);
+        delete trash.exchange(nullptr);
+        delete current;
+    }
+
+    // not the audio thread: designs the first set right away and starts the worker.
+    // getSettings is called from the worker, it should only read parameters
+    void prepare(double sampleRate, std::function<ChainSettings()> getSettings)
+    {
+        stop();
+        this->sampleRate = sampleRate;
+        this->getSettings = std::move(getSettings);
+
+        designed = this->getSettings();
+        delete pending.exchange(design(designed));
+        delete trash.exchange(nullptr);
+
+        running = true;
+        worker = std::thread(&CoefficientManager::run, this);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+    // audio thread, once per block; true if the chain got new coefficients
+    bool pull(MonoChain &chain)
+    {
+        // the last replaced set has not been collected yet, keep playing this one
+        if (trash.load(std::memory_order_acquire) != nullptr)
+            return false;
+
+        CoefficientSet *next = pending.exchange(nullptr, std::memory_order_acq_rel);
+        if (next == nullptr)
+            return false;
+
+        chain.setBypassed<ChainPositions::LowCut>(next->settings.lowCutBypassed);
+        chain.setBypassed<ChainPositions::HighCut>(next->settings.highCutBypassed);
+        updateCutFilter(chain.get<ChainPositions::LowCut>(), next->lowCut, next->settings.lowCutSlope);
+        updateCutFilter(chain.get<ChainPositions::HighCut>(), next->highCut, next->settings.highCutSlope);
+
+        // nothing reads the old set any more, so the worker can free it
+        trash.store(current, std::memory_order_release);
+        current = next;
+        return true;
+    }
+
+private:
+    double sampleRate = 44100.0;
+    std::function<ChainSettings()> getSettings;
+    ChainSettings designed; // what the newest set was built from, worker only after prepare
+
+    CoefficientSet *current = nullptr;           // owned by the audio thread
+    std::atomic<CoefficientSet *> pending{nullptr}; // newest design, not picked up yet
+    std::atomic<CoefficientSet *> trash{nullptr};   // replaced on the audio thread, freed here
+
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    CoefficientSet *design(const ChainSettings &settings) const
+    {
+        auto *set = new CoefficientSet;
+        set->settings = settings;
+        set->lowCut = makeLowCutFilter(settings, sampleRate);
+        set->highCut = makeHighCutFilter(settings, sampleRate);
+        return set;
+    }
+
+    void run()
+    {
+        while (running)
+        {
+            delete trash.exchange(nullptr, std::memory_order_acq_rel);
+
+            ChainSettings settings = getSettings();
+            if (settings != designed)
+            {
+                // a design the audio thread never picked up is stale, drop it
+                delete pending.exchange(design(settings), std::memory_order_acq_rel);
+                designed = settings;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+};
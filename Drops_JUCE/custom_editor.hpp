@@ -0,0 +1,95 @@
+#pragma once
+#include "plugin_processor.hpp"
+#include "spectrum_analyzer.hpp"
+
+// the generic parameter sliders with a spectrum and a level meter under them.
+// everything drawn here comes from the analyzers' published frames, the editor
+// never touches audio; it only polls them on a timer.
+class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor, private juce::Timer
+{
+public:
+    AudioPluginAudioProcessorEditor(juce::AudioProcessor &processor, SpectrumAnalyzer &left, SpectrumAnalyzer &right)
+        : juce::AudioProcessorEditor(processor), parameters(processor), left(left), right(right)
+    {
+        addAndMakeVisible(parameters);
+        left_frame.bands.assign(SpectrumAnalyzer::num_bands, SpectrumAnalyzer::min_db);
+        right_frame.bands.assign(SpectrumAnalyzer::num_bands, SpectrumAnalyzer::min_db);
+        setResizable(true, false);
+        setSize(std::max(400, parameters.getWidth()), parameters.getHeight() + spectrum_height);
+        startTimerHz((int)SpectrumAnalyzer::publish_rate);
+    }
+
+    ~AudioPluginAudioProcessorEditor() override
+    {
+        stopTimer();
+    }
+
+    void resized() override
+    {
+        auto area = getLocalBounds();
+        parameters.setBounds(area.removeFromTop(std::max(0, area.getHeight() - spectrum_height)));
+    }
+
+    void paint(juce::Graphics &g) override
+    {
+        g.fillAll(juce::Colours::black);
+
+        auto area = getLocalBounds().removeFromBottom(spectrum_height).reduced(4);
+        auto meter = area.removeFromRight(24);
+        area.removeFromRight(4);
+
+        g.setColour(juce::Colours::darkgrey);
+        g.drawRect(area);
+        g.setColour(juce::Colours::skyblue);
+        g.strokePath(make_path(left_frame, area.toFloat()), juce::PathStrokeType(1.5f));
+        g.setColour(juce::Colours::orange);
+        g.strokePath(make_path(right_frame, area.toFloat()), juce::PathStrokeType(1.f));
+
+        // rms as a bar, peak as a line, both channels in one meter
+        float rms = std::max(left_frame.rms_db, right_frame.rms_db);
+        float peak = std::max(left_frame.peak_db, right_frame.peak_db);
+        g.setColour(juce::Colours::darkgrey);
+        g.drawRect(meter);
+        g.setColour(juce::Colours::limegreen);
+        g.fillRect(meter.toFloat().withTop(db_to_y(rms, meter.toFloat())));
+        g.setColour(peak > -0.1f ? juce::Colours::red : juce::Colours::white);
+        g.drawHorizontalLine((int)db_to_y(peak, meter.toFloat()), (float)meter.getX(), (float)meter.getRight());
+    }
+
+private:
+    static constexpr int spectrum_height = 160;
+
+    juce::GenericAudioProcessorEditor parameters;
+    SpectrumAnalyzer &left, &right;
+    SpectrumAnalyzer::Frame left_frame, right_frame;
+
+    void timerCallback() override
+    {
+        // repaint only when a worker published something, a silent host costs nothing
+        bool changed = left.get_frame(left_frame);
+        changed = right.get_frame(right_frame) || changed;
+        if (changed)
+            repaint(getLocalBounds().removeFromBottom(spectrum_height));
+    }
+
+    static float db_to_y(float db, juce::Rectangle<float> area)
+    {
+        return juce::jmap(juce::jlimit(SpectrumAnalyzer::min_db, 0.f, db), SpectrumAnalyzer::min_db, 0.f, area.getBottom(), area.getY());
+    }
+
+    static juce::Path make_path(const SpectrumAnalyzer::Frame &frame, juce::Rectangle<float> area)
+    {
+        juce::Path path;
+        const int n = (int)frame.bands.size();
+        for (int b = 0; b < n; b++)
+        {
+            float x = juce::jmap((float)b, 0.f, (float)(n - 1), area.getX(), area.getRight());
+            float y = db_to_y(frame.bands[b], area);
+            if (b == 0)
+                path.startNewSubPath(x, y);
+            else
+                path.lineTo(x, y);
+        }
+        return path;
+    }
+};
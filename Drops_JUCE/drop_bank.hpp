@@ -0,0 +1,193 @@
+#pragma once
+#include <new>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "../common/simd.hpp"
+#include "drop_v2.hpp"
+
+// plain float array on a 16 byte boundary so the kernel can use aligned loads
+struct AlignedFloats
+{
+    float *data = nullptr;
+
+    AlignedFloats() = default;
+    AlignedFloats(const AlignedFloats &) = delete;
+    AlignedFloats &operator=(const AlignedFloats &) = delete;
+    ~AlignedFloats() { release(); }
+
+    void allocate(int size, float value = 0.f)
+    {
+        release();
+        data = static_cast<float *>(::operator new[](size * sizeof(float), std::align_val_t(16)));
+        std::fill(data, data + size, value);
+    }
+
+    void release()
+    {
+        if (data != nullptr)
+            ::operator delete[](data, std::align_val_t(16));
+        data = nullptr;
+    }
+
+    float &operator[](int i) { return data[i]; }
+    float operator[](int i) const { return data[i]; }
+};
+
+// the drops that are currently sounding, stored structure-of-arrays
+// every lane is one Drop_v2 window, counted in samples from its t_init
+// the kernel renders four lanes per instruction, a sample block at a time
+class DropBank
+{
+public:
+    static constexpr int block = 256; // samples per kernel pass
+
+    // per-lane state and constants
+    AlignedFloats n;      // samples since t_init, negative while still waiting inside the block
+    AlignedFloats n1;     // click ends
+    AlignedFloats tail;   // tail starts (the later of delta_t_1 and delta_t_2)
+    AlignedFloats n3;     // tail ends
+    AlignedFloats k1;     // 2 / (delta_t_1 * samplerate), maps n onto the click's -1..1
+    AlignedFloats a0;     // A0 * 2 / pi
+    AlignedFloats re;     // tail Resonator state, im is the output
+    AlignedFloats im;
+    AlignedFloats c;      // tail Resonator rotation
+    AlignedFloats s;
+
+    std::vector<int> id; // which drop each lane is playing
+    int count = 0;       // lanes [0, count) are live, the rest are silent padding
+    int capacity = 0;
+
+    AlignedFloats mix; // four partial sums per sample
+
+    void allocate(int lanes)
+    {
+        // round up to whole four-lane groups so the kernel never needs a remainder loop
+        capacity = (lanes + 3) & ~3;
+        for (auto *a : {&n, &n1, &tail, &n3, &k1, &a0, &re, &im, &c, &s})
+            a->allocate(capacity);
+        id.assign(capacity, -1);
+        count = 0;
+        mix.allocate(4 * block);
+    }
+
+    // start playing `drop` so that its t_init lands `offset` samples into the next block
+    void add(int drop_id, const Drop_v2 &drop, int offset, float samplerate)
+    {
+        assert(count < capacity);
+        int i = count++;
+        id[i] = drop_id;
+
+        float dt = 1.f / samplerate;
+        n[i] = -(float)offset;
+        n1[i] = drop.delta_t_1 * samplerate;
+        tail[i] = std::max(drop.delta_t_1, drop.delta_t_2) * samplerate;
+        n3[i] = drop.delta_t_3 * samplerate;
+        k1[i] = drop.delta_t_1 > 0.f ? 2.f * dt / drop.delta_t_1 : 0.f;
+        a0[i] = drop.A0 * 2.f / M_PI;
+
+        // Drop_v2 evaluates the tail at the time after the increment, hence the + 1
+        float first = std::ceil(tail[i]);
+        float u = (first + 1.f) * dt - drop.delta_t_2;
+        float length = drop.delta_t_3 - drop.delta_t_2;
+        Resonator ring;
+        if (length > 0.f)
+        {
+            ring.start(drop.A1, drop.m / length, 2.f * M_PI * drop.f, u, dt);
+        }
+        // otherwise the tail window is empty, n3 <= tail so it never plays
+        re[i] = ring.re;
+        im[i] = ring.im;
+        c[i] = ring.c;
+        s[i] = ring.s;
+    }
+
+    // calls done(drop_id) for every lane past the end of its window and frees the lane
+    template <typename Callback>
+    void retire_finished(Callback &&done)
+    {
+        for (int i = 0; i < count;)
+        {
+            // a click longer than delta_t_3 still plays out, like in Drop_v2
+            if (n[i] >= std::max(n1[i], n3[i]))
+            {
+                int finished = id[i];
+                move_lane(count - 1, i);
+                clear_lane(--count);
+                done(finished);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    // out = the sum of all live lanes, num_samples <= block
+    void render(float *out, int num_samples)
+    {
+        std::fill(mix.data, mix.data + 4 * num_samples, 0.f);
+
+        const f4 one = f4::set(1.f);
+        const f4 zero = f4::set(0.f);
+
+        // fast_acos coefficients, the argument is t * t so it is never negative
+        const f4 c0 = f4::set(-0.0187293f), c1 = f4::set(0.0742610f);
+        const f4 c2 = f4::set(-0.2121144f), c3 = f4::set(1.5707288f);
+
+        for (int g = 0; g < count; g += 4)
+        {
+            f4 n_ = f4::load(&n[g]);
+            f4 re_ = f4::load(&re[g]);
+            f4 im_ = f4::load(&im[g]);
+            const f4 n1_ = f4::load(&n1[g]), tail_ = f4::load(&tail[g]), n3_ = f4::load(&n3[g]);
+            const f4 k1_ = f4::load(&k1[g]), a0_ = f4::load(&a0[g]);
+            const f4 c_ = f4::load(&c[g]), s_ = f4::load(&s[g]);
+
+            for (int j = 0; j < num_samples; j++)
+            {
+                // impact click
+                m4 in_click = (n_ >= zero) & (n_ < n1_);
+                f4 t = (n_ + one) * k1_ - one;
+                f4 x = min(t * t, one);
+                f4 acos_ = (((c0 * x + c1) * x + c2) * x + c3) * sqrt(one - x);
+                f4 value = select(in_click, a0_ * acos_);
+
+                // damped sinusoid
+                m4 in_tail = (n_ >= tail_) & (n_ < n3_);
+                value = value + select(in_tail, im_);
+                f4 next = re_ * c_ - im_ * s_;
+                im_ = select(in_tail, re_ * s_ + im_ * c_, im_);
+                re_ = select(in_tail, next, re_);
+                n_ = n_ + one;
+
+                (f4::load(&mix[4 * j]) + value).store(&mix[4 * j]);
+            }
+
+            n_.store(&n[g]);
+            re_.store(&re[g]);
+            im_.store(&im[g]);
+        }
+
+        for (int j = 0; j < num_samples; j++)
+        {
+            out[j] = mix[4 * j] + mix[4 * j + 1] + mix[4 * j + 2] + mix[4 * j + 3];
+        }
+    }
+
+private:
+    void move_lane(int from, int to)
+    {
+        for (auto *a : {&n, &n1, &tail, &n3, &k1, &a0, &re, &im, &c, &s})
+            (*a)[to] = (*a)[from];
+        id[to] = id[from];
+    }
+
+    // a silent lane: both windows are empty whatever n gets to
+    void clear_lane(int i)
+    {
+        for (auto *a : {&n, &n1, &tail, &n3, &k1, &a0, &re, &im, &c, &s})
+            (*a)[i] = 0.f;
+        id[i] = -1;
+    }
+};
@@ -9,6 +9,35 @@
 #include <random>
 #include "utility.hpp"
 
+// damped complex phasor, amplitude * exp(-decay * u) * exp(i * omega * u)
+// the imaginary part is the damped sine, each sample is one complex multiply
+struct Resonator
+{
+    float re = 0.f, im = 0.f; // current state
+    float c = 1.f, s = 0.f;   // per-sample rotation with the decay folded in
+
+    // put the phasor at time u (seconds into the tail), dt is the sample period
+    void start(float amplitude, float decay, float omega, float u, float dt)
+    {
+        // the only transcendental calls, once per drop
+        double a = amplitude * std::exp(-(double)decay * u);
+        re = a * std::cos((double)omega * u);
+        im = a * std::sin((double)omega * u);
+        double g = std::exp(-(double)decay * dt);
+        c = g * std::cos((double)omega * dt);
+        s = g * std::sin((double)omega * dt);
+    }
+
+    float operator()()
+    {
+        float out = im;
+        float next = re * c - im * s;
+        im = re * s + im * c;
+        re = next;
+        return out;
+    }
+};
+
 class Drop_v2
 {
 public:
@@ -24,6 +53,10 @@ public:
     float m = 6.f;
     float f = 50.0f;
 
+    Resonator ring;           // renders the tail
+    bool ringing = false;     // ring has been started for this window
+    float dt = 1.f / 44100.f; // sample period, see prepare()
+
     Drop_v2(float t_init = 0.001, float delta_t_1 = 0.002, float delta_t_2 = 0.006, float delta_t_3 = 0.012, float A0 = 1.0, float A1 = 1.20f, float k = 3.0, float m = 6.0, float f = 1500.0)
     {
         this->t_init = t_init;
@@ -37,50 +70,69 @@ public:
         this->f = f;
     }
 
-    void reset(float end_time, float interval_coeff, float freq_coeff)
+    // the rate operator() steps time at
+    void prepare(float samplerate)
+    {
+        dt = 1.f / samplerate;
+    }
+
+    void reset(float end_time, float interval_coeff, float freq_coeff, Xoshiro &rng)
     {
-        this->t_init = rand_num_new(end_time);
-        this->delta_t_1 = interval_coeff * rand_num_new(0.002);
-        this->delta_t_2 = 0.002 + interval_coeff * rand_num_new(0.004);
-        this->delta_t_3 = 0.006 + interval_coeff * rand_num_new(0.006);
+        this->t_init = rng.uniform(end_time);
+        this->delta_t_1 = interval_coeff * rng.uniform(0.002f);
+        this->delta_t_2 = 0.002 + interval_coeff * rng.uniform(0.004f);
+        this->delta_t_3 = 0.006 + interval_coeff * rng.uniform(0.006f);
         this->A0 = 1.0f;
         this->A1 = 1.2f;
         this->k = 3.0f;
-        this->m = 3 + freq_coeff * rand_num_new(12);
-        this->f = 1000 + freq_coeff * rand_num_new(1000);
+        this->m = 3 + freq_coeff * rng.uniform(12.f);
+        this->f = 1000 + freq_coeff * rng.uniform(1000.f);
         this->time = 0.f;
+        this->ringing = false;
     };
 
+    // local time at which the drop falls silent again
+    float t_end() const
+    {
+        return t_init + std::max(delta_t_1, delta_t_3);
+    }
+
     float operator()()
     {
         float value = 0.f;
 
         if (time < t_init)
         {
-            time += 1.0f / 44100.0f;
+            time += dt;
             return value;
         }
         if (time < (t_init + delta_t_1))
         {
             // t range from -1 to 1
-            time += 1.0f / 44100.0f;
+            time += dt;
             float t = 2 * (time - t_init) / delta_t_1 - 1;
             return A0 * fast_acos(t * t) * 2 / M_PI;
         }
 
         if (time < (t_init + delta_t_2))
         {
-            time += 1.0f / 44100.0f;
+            time += dt;
             return value;
         }
         if (time < (t_init + delta_t_3))
         {
-            time += 1.0f / 44100.0f;
-            value = exp(-m * (time - t_init - delta_t_2) / (delta_t_3 - delta_t_2)) * A1 * sin(2 * M_PI * f * (time - t_init - delta_t_2));
+            time += dt;
+            if (!ringing)
+            {
+                // exp(-m * u / (delta_t_3 - delta_t_2)) * A1 * sin(2 * pi * f * u), evaluated once
+                ring.start(A1, m / (delta_t_3 - delta_t_2), 2 * M_PI * f, time - t_init - delta_t_2, dt);
+                ringing = true;
+            }
+            value = ring();
             return value;
         }
 
-        time += 1.0f / 44100.0f;
+        time += dt;
         return value;
     }
 };
\ No newline at end of file
@@ -1,32 +1,228 @@
 #include "utility.hpp"
 #include "drop_v2.hpp"
+#include "timing_wheel.hpp"
+#include "drop_bank.hpp"
+#include "grain_cache.hpp"
 
 class Drops_v2
 {
 public:
+    enum State : uint8_t
+    {
+        Idle,     // parked, not in the wheel
+        Armed,    // waiting in the wheel for its t_init
+        Sounding, // inside its window, has a lane in the bank or a grain voice
+    };
+
     std::vector<Drop_v2> drops;
-    uint num_drops;
-    uint counter;
+    std::vector<State> state;
+    std::vector<uint64_t> epoch; // sample at which each drop's current cycle started
+    TimingWheel wheel;
+    Xoshiro rng; // only ever used from the thread that renders
+    DropBank bank; // the drops currently inside their window
+    std::unique_ptr<GrainCache> cache;          // optional, see enable_grain_cache()
+    std::atomic<GrainCache *> live_cache{nullptr}; // cache once it is ready for the audio thread
+    GrainCache *active = nullptr;               // the audio thread's copy of live_cache
+    GrainVoices grains;                         // drops playing back from the cache
+    bool use_cache = false;
+
+    uint num_drops; // drops [0, num_drops) re-arm when they finish, the rest park
+    uint64_t counter; // current sample index
+
+    float samplerate = 44100.f;
+    float end_time = 1.f;
+    float interval_coeff = 1.f;
+    float freq_coeff = 0.5f;
+    uint cycle = 0; // samples between two consecutive starts of the same drop
 
     // randomness is a number between 0 and 1
     // this generates a sampler between 0 to 4 seconds
     Drops_v2(float randomness = 0.5, uint density = 1000, float end_time = 1.f, float single_drop_interval = 1.0f)
     {
         this->num_drops = density * end_time;
+        this->end_time = end_time;
+        this->interval_coeff = single_drop_interval;
+        this->freq_coeff = randomness;
+        prepare(num_drops, samplerate);
+    }
+
+    // preallocates a pool of `capacity` drops, the only place in here that allocates
+    // call it off the audio thread (prepareToPlay), everything else is allocation free
+    // frees the grain cache, enable_grain_cache() brings it back at the new rate
+    void prepare(uint capacity, float samplerate)
+    {
+        this->samplerate = samplerate;
         this->counter = 0;
-        for (int _ = 0; _ < num_drops; _++)
+        this->num_drops = std::min(num_drops, capacity);
+        // a drop used to be reset once its clock passed end_time + 12ms
+        this->cycle = (uint)ceil((end_time + 0.012f) * samplerate);
+
+        drops.resize(capacity);
+        for (auto &drop : drops)
         {
-            drops.push_back(Drop_v2(rand_num_new(end_time), single_drop_interval * rand_num_new(0.002), 0.002 + single_drop_interval * rand_num_new(0.004), 0.006 + single_drop_interval * rand_num_new(0.006), 1.0f, 1.2f, 3.0, 3 + randomness * rand_num_new(12), 1000 + randomness * rand_num_new(1000)));
+            drop.prepare(samplerate);
+            drop.reset(end_time, interval_coeff, freq_coeff, rng);
+        }
+        state.assign(capacity, Idle);
+        epoch.assign(capacity, 0);
+        bank.allocate(capacity);
+        wheel.allocate(capacity, cycle);
+        grains.allocate(capacity);
+        live_cache.store(nullptr);
+        active = nullptr;
+        use_cache = false;
+        cache.reset();
+
+        for (uint i = 0; i < num_drops; i++)
+        {
+            arm(i, 0);
+        }
+    }
+
+    uint capacity() const
+    {
+        return drops.size();
+    }
+
+    // how many drops of the pool keep re-arming, clamped to the pool
+    // O(1) per drop that comes back, drops that go away finish their window and then park
+    void set_density(uint density)
+    {
+        density = std::min<uint>(density, capacity());
+        for (uint i = num_drops; i < density; i++)
+        {
+            if (state[i] == Idle)
+                arm(i, counter);
+        }
+        num_drops = density;
+    }
+
+    // not the audio thread, nor at the same time as prepare(): allocates the grain cache
+    // the first time and (re)starts its render thread
+    void enable_grain_cache(size_t budget_bytes)
+    {
+        if (cache != nullptr)
+        {
+            cache->start();
+            return;
+        }
+        auto fresh = std::make_unique<GrainCache>();
+        fresh->prepare(samplerate, budget_bytes);
+        cache = std::move(fresh);
+        live_cache.store(cache.get(), std::memory_order_release);
+    }
+
+    // not the audio thread: parks the render thread. the table stays for the grains
+    // still playing from it, the next prepare() frees it
+    void disable_grain_cache()
+    {
+        if (cache != nullptr)
+            cache->stop();
+    }
+
+    // audio thread, once per block. drops snap to the cache grid and play from the
+    // cache when they can, from the moment enable_grain_cache() has one ready
+    void set_grain_cache(bool enabled)
+    {
+        active = live_cache.load(std::memory_order_acquire);
+        bool was_on = use_cache;
+        use_cache = enabled && active != nullptr;
+        if (use_cache && !was_on)
+        {
+            // the drops waiting in the wheel were drawn off the grid, t_init stays put
+            for (uint i = 0; i < capacity(); i++)
+            {
+                if (state[i] == Armed)
+                    active->quantize(drops[i]);
+            }
+        }
+    }
+
+    // used by reset() when a drop re-arms
+    void set_coeffs(float interval_coeff, float freq_coeff)
+    {
+        this->interval_coeff = interval_coeff;
+        this->freq_coeff = freq_coeff;
+    }
+
+    // renders the next num_samples samples of rain into out
+    void render(float *out, int num_samples)
+    {
+        for (int done = 0; done < num_samples;)
+        {
+            int n = std::min(num_samples - done, DropBank::block);
+
+            // everything that starts inside this block gets a lane up front
+            for (int s = 0; s < n; s++)
+            {
+                wheel.pop(counter + s, [this, s](int i)
+                          { wake(i, s); });
+            }
+
+            bank.render(out + done, n);
+            counter += n;
+            bank.retire_finished([this](int i)
+                                 { retire(i); });
+            if (active != nullptr)
+            {
+                grains.render(out + done, n, *active);
+                grains.retire_finished(*active, [this](int i)
+                                       { retire(i); });
+                active->advance();
+            }
+            done += n;
         }
     }
 
     float operator()()
     {
         float res = 0.0f;
-        for (int i = 0; i < drops.size(); i++)
+        render(&res, 1);
+        return res;
+    }
+
+private:
+    void arm(int i, uint64_t start)
+    {
+        epoch[i] = start;
+        state[i] = Armed;
+        wheel.schedule(i, start + (uint64_t)(drops[i].t_init * samplerate));
+    }
+
+    void wake(int i, int offset)
+    {
+        if ((uint)i >= num_drops)
         {
-            res += drops[i]();
+            state[i] = Idle;
+            return;
         }
-        return res;
+        state[i] = Sounding;
+        if (use_cache)
+        {
+            uint64_t key = GrainCache::key_of(drops[i]);
+            int slot = active->acquire(key);
+            if (slot >= 0)
+            {
+                grains.add(i, slot, offset, drops[i].A0);
+                return;
+            }
+            // synthesize this one, the next drop like it should find it cached
+            active->request(key);
+        }
+        bank.add(i, drops[i], offset, samplerate);
+    }
+
+    void retire(int i)
+    {
+        if ((uint)i >= num_drops)
+        {
+            state[i] = Idle;
+            return;
+        }
+        drops[i].reset(end_time, interval_coeff, freq_coeff, rng);
+        if (use_cache)
+            active->quantize(drops[i]);
+        // long tails (big interval coeff) can run past the end of the cycle
+        arm(i, std::max<uint64_t>(epoch[i] + cycle, counter));
     }
-};
\ No newline at end of file
+};
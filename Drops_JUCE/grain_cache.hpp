@@ -0,0 +1,347 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "drop_v2.hpp"
+#include "drop_bank.hpp"
+
+// prerendered Drop_v2 windows ("grains") for a quantized set of drop parameters.
+// the audio thread asks for a grain with acquire(); on a miss it queues a
+// request() and synthesizes as usual, a background thread renders the grain
+// into a fixed table so the next drop with the same parameters is a table read.
+// the table is set associative with LRU replacement inside each set, its size is
+// fixed by the memory budget passed to prepare().
+class GrainCache
+{
+public:
+    // grid sizes, the ranges are what Drop_v2::reset can produce with both coeffs at 4
+    static constexpr int time_levels = 8;  // delta_t_1, delta_t_2, delta_t_3
+    static constexpr int decay_levels = 8; // m
+    static constexpr int freq_levels = 32; // f
+    static constexpr int ratio_levels = 64; // A1 / A0
+    static constexpr int ways = 8;
+
+    ~GrainCache()
+    {
+        stop();
+    }
+
+    // allocates the table and starts the render thread, not the audio thread
+    void prepare(float samplerate, size_t budget_bytes)
+    {
+        stop();
+        this->samplerate = samplerate;
+        // the longest window reset() can produce, max(delta_t_1, delta_t_3)
+        grain_length = (int)std::ceil(0.030f * samplerate) + 2;
+        int num_slots = std::max<int>(ways, budget_bytes / (grain_length * sizeof(float)) / ways * ways);
+        num_sets = num_slots / ways;
+
+        table.assign((size_t)num_slots * grain_length, 0.f);
+        slots = std::make_unique<Slot[]>(num_slots);
+        requests.assign(request_capacity, 0);
+        request_read.store(0);
+        request_write.store(0);
+        tick.store(0);
+
+        start();
+    }
+
+    // not the audio thread; the table is kept, requests queued meanwhile are rendered now
+    void start()
+    {
+        if (running)
+            return;
+        running = true;
+        worker = std::thread(&GrainCache::run, this);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+    // snaps a drop onto the grid, so what gets synthesized on a miss is exactly what gets cached
+    void quantize(Drop_v2 &drop) const
+    {
+        decode(key_of(drop), drop);
+    }
+
+    static uint64_t key_of(const Drop_v2 &drop)
+    {
+        uint64_t key = 0;
+        key = key << 8 | code(drop.delta_t_1, 0.f, 0.008f, time_levels);
+        key = key << 8 | code(drop.delta_t_2, 0.002f, 0.018f, time_levels);
+        key = key << 8 | code(drop.delta_t_3, 0.006f, 0.030f, time_levels);
+        key = key << 8 | code(drop.m, 3.f, 51.f, decay_levels);
+        key = key << 8 | code(drop.f, 1000.f, 5000.f, freq_levels);
+        key = key << 8 | code(drop.A0 > 0.f ? drop.A1 / drop.A0 : 0.f, 0.f, 4.f, ratio_levels);
+        // 0 marks an empty slot
+        return key + 1;
+    }
+
+    // audio thread: a pinned slot holding the grain, or -1 on a miss
+    int acquire(uint64_t key)
+    {
+        int set = (int)(hash(key) % num_sets);
+        for (int s = set * ways; s < (set + 1) * ways; s++)
+        {
+            Slot &slot = slots[s];
+            if (slot.state.load(std::memory_order_acquire) != Ready || slot.key.load(std::memory_order_relaxed) != key)
+                continue;
+            // pin, then make sure the render thread did not take the slot in between
+            slot.pins.fetch_add(1);
+            if (slot.state.load() == Ready && slot.key.load() == key)
+            {
+                slot.last_used.store(tick.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return s;
+            }
+            slot.pins.fetch_sub(1);
+        }
+        return -1;
+    }
+
+    // audio thread, done playing a slot from acquire()
+    void release(int slot)
+    {
+        slots[slot].pins.fetch_sub(1);
+    }
+
+    // audio thread, ask for a grain to be rendered; a full queue just drops the request
+    void request(uint64_t key)
+    {
+        size_t w = request_write.load(std::memory_order_relaxed);
+        if (w - request_read.load(std::memory_order_acquire) == request_capacity)
+            return;
+        requests[w & (request_capacity - 1)] = key;
+        request_write.store(w + 1, std::memory_order_release);
+    }
+
+    // audio thread, once per block; the clock the LRU runs on
+    void advance()
+    {
+        tick.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const float *grain(int slot) const
+    {
+        return &table[(size_t)slot * grain_length];
+    }
+
+    int length(int slot) const
+    {
+        return slots[slot].length.load(std::memory_order_relaxed);
+    }
+
+private:
+    enum State : int
+    {
+        Empty,
+        Rendering,
+        Ready,
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> key{0};
+        std::atomic<int> state{Empty};
+        std::atomic<int> pins{0};
+        std::atomic<int> length{0};
+        std::atomic<uint32_t> last_used{0};
+    };
+
+    static constexpr size_t request_capacity = 1024;
+
+    float samplerate = 44100.f;
+    int grain_length = 0;
+    int num_sets = 1;
+    std::vector<float> table;
+    std::unique_ptr<Slot[]> slots;
+
+    std::vector<uint64_t> requests;
+    std::atomic<size_t> request_read{0};
+    std::atomic<size_t> request_write{0};
+    std::atomic<uint32_t> tick{0};
+
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    static uint64_t code(float value, float lo, float hi, int levels)
+    {
+        int i = (int)((value - lo) / (hi - lo) * levels);
+        return (uint64_t)std::min(std::max(i, 0), levels - 1);
+    }
+
+    // the middle of a grid cell
+    static float level(uint64_t code, float lo, float hi, int levels)
+    {
+        return lo + (hi - lo) * ((float)code + 0.5f) / levels;
+    }
+
+    static void decode(uint64_t key, Drop_v2 &drop)
+    {
+        key -= 1;
+        float ratio = level(key & 0xff, 0.f, 4.f, ratio_levels);
+        drop.f = level(key >> 8 & 0xff, 1000.f, 5000.f, freq_levels);
+        drop.m = level(key >> 16 & 0xff, 3.f, 51.f, decay_levels);
+        drop.delta_t_3 = level(key >> 24 & 0xff, 0.006f, 0.030f, time_levels);
+        drop.delta_t_2 = level(key >> 32 & 0xff, 0.002f, 0.018f, time_levels);
+        drop.delta_t_1 = level(key >> 40 & 0xff, 0.f, 0.008f, time_levels);
+        drop.A1 = drop.A0 * ratio;
+    }
+
+    static uint64_t hash(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    void run()
+    {
+        // one lane is all the render thread needs, the kernel makes it bit-exact with live drops
+        DropBank bank;
+        bank.allocate(1);
+
+        while (running)
+        {
+            size_t r = request_read.load(std::memory_order_relaxed);
+            size_t w = request_write.load(std::memory_order_acquire);
+            for (; r != w; r++)
+            {
+                render(bank, requests[r & (request_capacity - 1)]);
+                request_read.store(r + 1, std::memory_order_release);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    void render(DropBank &bank, uint64_t key)
+    {
+        int set = (int)(hash(key) % num_sets);
+        int victim = -1;
+        for (int s = set * ways; s < (set + 1) * ways; s++)
+        {
+            Slot &slot = slots[s];
+            int state = slot.state.load();
+            if (state != Empty && slot.key.load() == key)
+                return; // already there, an earlier request for it got here first
+            if (state == Empty)
+            {
+                victim = s;
+                break;
+            }
+            // least recently used of the grains nobody is playing
+            if (slot.pins.load() == 0 && (victim < 0 || slot.last_used.load() < slots[victim].last_used.load()))
+                victim = s;
+        }
+        if (victim < 0)
+            return; // every way of the set is playing right now
+
+        Slot &slot = slots[victim];
+        int expected = slot.state.load();
+        if (!slot.state.compare_exchange_strong(expected, Rendering))
+            return;
+        if (slot.pins.load() != 0)
+        {
+            // a voice pinned it between our look and the swap, leave it be
+            slot.state.store(expected);
+            return;
+        }
+
+        Drop_v2 drop;
+        drop.A0 = 1.f;
+        decode(key, drop);
+        int length = std::min(grain_length, (int)std::ceil(std::max(drop.delta_t_1, drop.delta_t_3) * samplerate) + 1);
+
+        float *out = &table[(size_t)victim * grain_length];
+        bank.add(0, drop, 0, samplerate);
+        for (int done = 0; done < length; done += DropBank::block)
+        {
+            bank.render(out + done, std::min(DropBank::block, length - done));
+        }
+        // length covers the whole window, so this frees the lane for the next grain
+        bank.retire_finished([](int) {});
+
+        slot.key.store(key);
+        slot.length.store(length);
+        slot.last_used.store(tick.load());
+        slot.state.store(Ready, std::memory_order_release);
+    }
+};
+
+// drops that are being played back from the cache, one per sounding drop at most
+struct GrainVoices
+{
+    std::vector<int> id;   // drop index
+    std::vector<int> slot; // cache slot, pinned while playing
+    std::vector<int> pos;  // next grain sample, negative while the start is still ahead in the block
+    std::vector<float> gain;
+    int count = 0;
+
+    void allocate(int capacity)
+    {
+        id.assign(capacity, -1);
+        slot.assign(capacity, -1);
+        pos.assign(capacity, 0);
+        gain.assign(capacity, 0.f);
+        count = 0;
+    }
+
+    void add(int drop_id, int cache_slot, int offset, float voice_gain)
+    {
+        id[count] = drop_id;
+        slot[count] = cache_slot;
+        pos[count] = -offset;
+        gain[count] = voice_gain;
+        count++;
+    }
+
+    // adds every voice into out, then advances them by num_samples
+    void render(float *out, int num_samples, const GrainCache &cache)
+    {
+        for (int v = 0; v < count; v++)
+        {
+            const float *grain = cache.grain(slot[v]);
+            int length = cache.length(slot[v]);
+            int p = pos[v];
+            int first = std::max(0, -p);
+            int last = std::min(num_samples, length - p);
+            const float g = gain[v];
+            for (int j = first; j < last; j++)
+            {
+                out[j] += g * grain[p + j];
+            }
+            pos[v] += num_samples;
+        }
+    }
+
+    // calls done(drop_id) for every voice that reached the end of its grain
+    template <typename Callback>
+    void retire_finished(GrainCache &cache, Callback &&done)
+    {
+        for (int v = 0; v < count;)
+        {
+            if (pos[v] >= cache.length(slot[v]))
+            {
+                int finished = id[v];
+                cache.release(slot[v]);
+                count--;
+                id[v] = id[count];
+                slot[v] = slot[count];
+                pos[v] = pos[count];
+                gain[v] = gain[count];
+                done(finished);
+            }
+            else
+            {
+                v++;
+            }
+        }
+    }
+};
@@ -1,20 +1,27 @@
 #include "drops_v2.hpp"
 #include "plugin_processor.hpp"
+#include "coefficient_manager.hpp"
+#include "spectrum_analyzer.hpp"
+#include "custom_editor.hpp"
+#include "../common/realtime_guard.hpp"
 #include <mutex>
 #include <thread>
 
 using namespace juce;
-struct Raindrops : public AudioProcessor
+struct Raindrops : public AudioProcessor,
+                   private AudioProcessorParameter::Listener,
+                   private AsyncUpdater
 {
-  MonoChain leftChain, rightChain;
+  // Raindrops is mono: the drops and the noise are one signal, so one chain
+  // filters it and right is a copy of left
+  MonoChain leftChain;
+  CoefficientManager filterCoefficients;
   using BlockType = juce::AudioBuffer<float>;
-  using Filter = juce::dsp::IIR::Filter<float>;
-  using Coefficients = Filter::CoefficientsPtr;
-  using CutFilter = juce::dsp::ProcessorChain<Filter, Filter, Filter, Filter>;
-  using MonoChain = juce::dsp::ProcessorChain<CutFilter, Filter, CutFilter>;
 
   SingleChannelSampleFifo<BlockType> leftChannelFifo{Channel::Left};
   SingleChannelSampleFifo<BlockType> rightChannelFifo{Channel::Right};
+  // the fifos' only readers, on their own threads; the editor shows what they publish
+  SpectrumAnalyzer leftAnalyzer, rightAnalyzer;
 
   AudioParameterFloat *noise_level;
   AudioParameterFloat *gain;
@@ -27,8 +34,18 @@ struct Raindrops : public AudioProcessor
   AudioParameterBool *LPF_enabled;
   AudioParameterFloat *LPF_freq;
 
+  AudioParameterBool *grain_cache;
+
+  // the drop pool is sized once in prepareToPlay, density just picks how much of it plays
+  static constexpr uint max_drops = 10000;
+  static constexpr size_t grain_cache_bytes = 32 << 20;
+  // the grain cache is set up and parked on the message thread, apart from prepareToPlay
+  std::mutex grainCacheLock;
   std::unique_ptr<Drops_v2> drops = std::make_unique<Drops_v2>(0.5, 100, 1.0f);
+  Xoshiro rng; // background noise
   float running_max = -20.f;
+  // where a double precision block is rendered, sized in prepareToPlay
+  AudioBuffer<float> floatBuffer;
 
   Raindrops()
       : AudioProcessor(BusesProperties()
@@ -40,7 +57,7 @@ struct Raindrops : public AudioProcessor
                      NormalisableRange<float>(-65.f, -1.f, 0.01f), -65.f));
     addParameter(density = new AudioParameterFloat(
                      {"density", 1}, "Density",
-                     NormalisableRange<float>(1.f, 400.f, 1.f), 10.f));
+                     NormalisableRange<float>(1.f, (float)max_drops, 1.f, 0.3f), 10.f));
     addParameter(freq_coeff = new AudioParameterFloat(
                      {"randomness", 1}, "Freq Coeff",
                      NormalisableRange<float>(0.1f, 4.0f, 0.1f), 4.0f));
@@ -60,53 +77,113 @@ struct Raindrops : public AudioProcessor
                      {"HPF Enabled", 1}, "HPF Enabled", true));
     addParameter(LPF_enabled = new AudioParameterBool(
                      {"LPF Enabled", 1}, "LPF Enabled", true));
+    addParameter(grain_cache = new AudioParameterBool(
+                     {"grain_cache", 1}, "Grain Cache", false));
+    grain_cache->addListener(this);
+  }
+
+  ~Raindrops() override
+  {
+    grain_cache->removeListener(this);
+    cancelPendingUpdate();
+  }
+
+  // hosts may call this from the audio thread, the cache is allocated on the message thread
+  void parameterValueChanged(int, float) override { triggerAsyncUpdate(); }
+  void parameterGestureChanged(int, bool) override {}
+
+  void handleAsyncUpdate() override
+  {
+    const std::lock_guard<std::mutex> lock(grainCacheLock);
+    if (grain_cache->get())
+      drops->enable_grain_cache(grain_cache_bytes);
+    else
+      drops->disable_grain_cache();
   }
 
   /// this function handles the audio ///////////////////////////////////////
   void processBlock(AudioBuffer<float> &buffer, MidiBuffer &) override
   {
+    RealtimeScope realtime;
 
-    updateFilters();
+    // swaps in new coefficients when a filter parameter changed, nothing otherwise
+    filterCoefficients.pull(leftChain);
     auto left = buffer.getWritePointer(0, 0);
     auto right = buffer.getWritePointer(1, 0);
 
+    // the scheduler re-arms finished drops itself, we just tell it how many
+    drops->set_density((uint)density->get());
+    drops->set_coeffs(single_drop_interval->get(), freq_coeff->get());
+    // trades a little parameter resolution for table reads at high densities
+    drops->set_grain_cache(grain_cache->get());
+
+    // the drops go straight into the left channel, everything below is per sample
+    drops->render(left, buffer.getNumSamples());
+    // right only gets a copy of left at the end, so borrow it for the noise
+    rng.fill_uniform(right, buffer.getNumSamples(), -1.f, 1.f);
+
     for (int i = 0; i < buffer.getNumSamples(); ++i)
     {
 
-      float res = 0.0f;
-      res = drops->operator()();
-      for (int k = 0; k < density->get(); ++k)
-      {
-        if (drops->drops[k].time > 1.012f)
-          drops->drops[k].reset(1.0f, single_drop_interval->get(), freq_coeff->get());
-      }
+      float res = left[i];
 
       if (fabs(res) > fabs(running_max))
       {
         running_max = res;
       }
 
-      float noise = rand_num_new(-1.f, 1.f);
+      float noise = right[i];
       left[i] = soft_clip(res * dbtoa(gain->get()) / fabs(running_max) + noise_level->get() * noise);
-      right[i] = left[i];
     }
 
     // 1.wrap the buffer with audio block
     juce::dsp::AudioBlock<float> block(buffer);
-    // 2.extract individual data
+    // 2.extract the channel the chain runs on
     auto leftBlock = block.getSingleChannelBlock(0);
-    auto rightBlock = block.getSingleChannelBlock(1);
     // 3.wrap the block to a context which the process chain could use
     juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
-    juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
-    // 4.pass the context to filter chains
+    // 4.pass the context to the filter chain; the source is mono, so it is
+    // filtered once and copied to the right channel
     leftChain.process(leftContext);
-    rightChain.process(rightContext);
+    buffer.copyFrom(1, 0, buffer, 0, 0, buffer.getNumSamples());
     // no effects till now since there's no efficient set
     leftChannelFifo.update(buffer);
     rightChannelFifo.update(buffer);
   }
 
+  // the drop engine, the cut filters and the analyzer fifos are all float, so a
+  // double host gets the float block widened once here. that still saves the
+  // host's conversion of the input, which we never read.
+  // floatBuffer keeps the size prepareToPlay gave it; a longer host block is
+  // rendered a floatBuffer at a time. the MIDI goes along unsplit, Raindrops
+  // ignores it
+  void processBlock(AudioBuffer<double> &buffer, MidiBuffer &midiMessages) override
+  {
+    RealtimeScope realtime;
+    const int numSamples = buffer.getNumSamples();
+    const int capacity = floatBuffer.getNumSamples();
+    if (capacity == 0)
+    {
+      buffer.clear();
+      return;
+    }
+    for (int start = 0; start < numSamples; start += capacity)
+    {
+      const int n = std::min(capacity, numSamples - start);
+      // refers to floatBuffer's channels, nothing is allocated
+      AudioBuffer<float> chunk(floatBuffer.getArrayOfWritePointers(), 2, 0, n);
+      processBlock(chunk, midiMessages);
+      for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+      {
+        auto source = chunk.getReadPointer(std::min(ch, 1));
+        auto dest = buffer.getWritePointer(ch, start);
+        for (int i = 0; i < n; ++i)
+          dest[i] = source[i];
+      }
+    }
+  }
+  bool supportsDoublePrecisionProcessing() const override { return true; }
+
   /// start and shutdown callbacks///////////////////////////////////////////
   void prepareToPlay(double sampleRate, int samplesPerBlock) override
   {
@@ -117,49 +194,26 @@ struct Raindrops : public AudioProcessor
     // monoChain so numChannel to be 1
 
     leftChain.prepare(spec);
-    rightChain.prepare(spec);
-    updateFilters();
-
-    // prepare fifo
-    leftChannelFifo.prepare(samplesPerBlock);
-    rightChannelFifo.prepare(samplesPerBlock);
-  }
-
-  void updateFilters()
-  {
-    auto chainSettings = getChainSettings();
-    updateLowCutFilter(chainSettings);
-    updateHighCutFilter(chainSettings);
-  };
-
-  void updateLowCutFilter(const ChainSettings &chainSettings)
-  {
-
-    auto lowCutCoefficients = makeLowCutFilter(chainSettings, getSampleRate());
-
-    auto &leftLowCut = leftChain.get<ChainPositions::LowCut>();
-    auto &rightLowCut = rightChain.get<ChainPositions::LowCut>();
+    filterCoefficients.prepare(sampleRate, [this]()
+                               { return getChainSettings(); });
+    filterCoefficients.pull(leftChain);
 
-    leftChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed);
-    rightChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed);
-
-    updateCutFilter(leftLowCut, lowCutCoefficients, chainSettings.lowCutSlope);
-    updateCutFilter(rightLowCut, lowCutCoefficients, chainSettings.lowCutSlope);
-  }
-
-  void updateHighCutFilter(const ChainSettings &chainSettings)
-  {
-
-    auto highCutCoefficients = makeHighCutFilter(chainSettings, getSampleRate());
-
-    auto &leftHighCut = leftChain.get<ChainPositions::HighCut>();
-    auto &rightHighCut = rightChain.get<ChainPositions::HighCut>();
-
-    leftChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed);
-    rightChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed);
-
-    updateCutFilter(leftHighCut, highCutCoefficients, chainSettings.highCutSlope);
-    updateCutFilter(rightHighCut, highCutCoefficients, chainSettings.highCutSlope);
+    {
+      const std::lock_guard<std::mutex> lock(grainCacheLock);
+      drops->prepare(max_drops, (float)sampleRate);
+      // nothing is allocated for the cache while it is off
+      if (grain_cache->get())
+        drops->enable_grain_cache(grain_cache_bytes);
+    }
+    floatBuffer.setSize(2, samplesPerBlock);
+
+    // prepare fifo, its reader has to be stopped while the ring is replaced
+    leftAnalyzer.stop();
+    rightAnalyzer.stop();
+    leftChannelFifo.prepare(samplesPerBlock, 4 * SpectrumAnalyzer::hop);
+    rightChannelFifo.prepare(samplesPerBlock, 4 * SpectrumAnalyzer::hop);
+    leftAnalyzer.prepare(leftChannelFifo, sampleRate);
+    rightAnalyzer.prepare(rightChannelFifo, sampleRate);
   }
 
   ChainSettings getChainSettings()
@@ -176,6 +230,11 @@ struct Raindrops : public AudioProcessor
 
   void releaseResources() override
   {
+    filterCoefficients.stop();
+    leftAnalyzer.stop();
+    rightAnalyzer.stop();
+    const std::lock_guard<std::mutex> lock(grainCacheLock);
+    drops->disable_grain_cache();
   }
 
   /// maintaining persistant state on suspend ///////////////////////////////
@@ -232,8 +291,7 @@ struct Raindrops : public AudioProcessor
   /// automagic user interface //////////////////////////////////////////////
   AudioProcessorEditor *createEditor() override
   {
-    // return new AudioPluginAudioProcessorEditor(*this);
-    return new GenericAudioProcessorEditor(*this);
+    return new AudioPluginAudioProcessorEditor(*this, leftAnalyzer, rightAnalyzer);
   }
   bool hasEditor() const override { return true; }
 
@@ -244,4 +302,4 @@ private:
 AudioProcessor *JUCE_CALLTYPE createPluginFilter()
 {
   return new Raindrops();
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,4 +1,8 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
 #include <juce_analytics/juce_analytics.h>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_audio_devices/juce_audio_devices.h>
@@ -14,11 +18,66 @@
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <juce_gui_extra/juce_gui_extra.h>
 #include <juce_audio_processors/juce_audio_processors.h>
-// #include "custom_editor.hpp"
+#include "biquad_cascade.hpp"
 
 using Filter = juce::dsp::IIR::Filter<float>;
 using Coefficients = Filter::CoefficientsPtr;
-using CutFilter = juce::dsp::ProcessorChain<Filter, Filter, Filter, Filter>;
+
+// a Butterworth cut filter of up to four sections, as a ProcessorChain stage.
+// BiquadCascade does the work, with the channels of the context in SIMD lanes,
+// or with its sections in the lanes when the context is mono like MonoChain
+struct CutFilter
+{
+    static constexpr int maxChannels = 16;
+
+    void prepare(const juce::dsp::ProcessSpec &spec)
+    {
+        jassert(spec.numChannels <= (juce::uint32)maxChannels);
+        cascade.prepare((int)spec.numChannels, (int)spec.maximumBlockSize);
+    }
+
+    void reset()
+    {
+        cascade.reset();
+    }
+
+    template <typename ProcessContext>
+    void process(const ProcessContext &context)
+    {
+        auto &&inputBlock = context.getInputBlock();
+        auto &&outputBlock = context.getOutputBlock();
+        if (context.usesSeparateInputAndOutputBlocks())
+            outputBlock.copyFrom(inputBlock);
+        if (context.isBypassed)
+            return;
+
+        float *channels[maxChannels];
+        int numChannels = std::min((int)outputBlock.getNumChannels(), maxChannels);
+        for (int ch = 0; ch < numChannels; ++ch)
+            channels[ch] = outputBlock.getChannelPointer((size_t)ch);
+        cascade.process(channels, numChannels, (int)outputBlock.getNumSamples());
+    }
+
+    // the first numSections designed sections go live; no allocation, fine on the audio thread
+    template <typename CoefficientType>
+    void setCoefficients(const CoefficientType &coefficients, int numSections)
+    {
+        numSections = std::min({numSections, coefficients.size(), BiquadCascade::max_sections});
+        for (int k = 0; k < numSections; ++k)
+        {
+            const auto &c = coefficients.getObjectPointerUnchecked(k)->coefficients;
+            // {b0, b1, b2, a1, a2}, or {b0, b1, a1} for a first order section
+            if (c.size() == 5)
+                cascade.set_section(k, c[0], c[1], c[2], c[3], c[4]);
+            else
+                cascade.set_section(k, c[0], c[1], 0.f, c[2], 0.f);
+        }
+        cascade.set_num_sections(numSections);
+    }
+
+    BiquadCascade cascade;
+};
+
 using MonoChain = juce::dsp::ProcessorChain<CutFilter, Filter, CutFilter>;
 
 enum ChainPositions
@@ -34,70 +93,101 @@ enum Channel
     Right // i.e.1
 };
 
-template <typename T>
-struct Fifo
+// single-producer/single-consumer ring of raw floats.
+// the producer writes whole blocks with at most two memcpys, the consumer gets
+// views straight into the ring and says how much it used with consume().
+// the indices only ever grow, masking turns them into positions.
+struct SampleFifo
 {
-    void prepare(int numChannels, int numSamples)
+    // a readable region, split in two where it wraps around the end of the ring
+    struct Span
     {
-        static_assert(std::is_same_v<T, juce::AudioBuffer<float>>,
-                      "prepare(numChannels, numSamples) should only be used when the Fifo is holding juce::AudioBuffer<float>");
-        for (auto &buffer : buffers)
-        {
-            buffer.setSize(numChannels,
-                           numSamples,
-                           false, // clear everything?
-                           true,  // including the extra space?
-                           true); // avoid reallocating if you can?
-            buffer.clear();
-        }
+        const float *first = nullptr;
+        int firstSize = 0;
+        const float *second = nullptr;
+        int secondSize = 0;
+
+        int size() const { return firstSize + secondSize; }
+    };
+
+    // not the audio thread, capacity is rounded up to a power of two
+    void prepare(int numSamples)
+    {
+        size_t size = 1;
+        while (size < (size_t)numSamples)
+            size <<= 1;
+        ring.assign(size, 0.f);
+        mask = size - 1;
+        readIndex.store(0);
+        writeIndex.store(0);
+        dropped.store(0);
     }
 
-    void prepare(size_t numElements)
+    // producer; what does not fit is counted and thrown away, returns how much went in
+    int write(const float *samples, int numSamples)
     {
-        static_assert(std::is_same_v<T, std::vector<float>>,
-                      "prepare(numElements) should only be used when the Fifo is holding std::vector<float>");
-        for (auto &buffer : buffers)
-        {
-            buffer.clear();
-            buffer.resize(numElements, 0);
-        }
+        size_t w = writeIndex.load(std::memory_order_relaxed);
+        size_t space = ring.size() - (w - readIndex.load(std::memory_order_acquire));
+        int n = (int)std::min<size_t>(space, (size_t)numSamples);
+
+        size_t start = w & mask;
+        size_t first = std::min<size_t>(n, ring.size() - start);
+        std::memcpy(&ring[start], samples, first * sizeof(float));
+        std::memcpy(&ring[0], samples + first, (n - first) * sizeof(float));
+
+        writeIndex.store(w + n, std::memory_order_release);
+        if (n < numSamples)
+            dropped.fetch_add(numSamples - n, std::memory_order_relaxed);
+        return n;
     }
 
-    bool push(const T &t)
+    // consumer; the oldest maxSamples (or fewer) unread samples, valid until consume()
+    Span read(int maxSamples) const
     {
-        auto write = fifo.write(1);
-        if (write.blockSize1 > 0)
-        {
-            buffers[write.startIndex1] = t;
-            return true;
-        }
+        size_t r = readIndex.load(std::memory_order_relaxed);
+        size_t available = writeIndex.load(std::memory_order_acquire) - r;
+        size_t n = std::min<size_t>(available, (size_t)maxSamples);
 
-        return false;
+        Span span;
+        size_t start = r & mask;
+        span.first = &ring[start];
+        span.firstSize = (int)std::min<size_t>(n, ring.size() - start);
+        span.second = &ring[0];
+        span.secondSize = (int)n - span.firstSize;
+        return span;
     }
 
-    bool pull(T &t)
+    // consumer, done with the first numSamples of the last read()
+    void consume(int numSamples)
     {
-        auto read = fifo.read(1);
-        if (read.blockSize1 > 0)
-        {
-            t = buffers[read.startIndex1];
-            return true;
-        }
+        readIndex.store(readIndex.load(std::memory_order_relaxed) + numSamples, std::memory_order_release);
+    }
+
+    int getNumReady() const
+    {
+        return (int)(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire));
+    }
 
-        return false;
+    int getCapacity() const
+    {
+        return (int)ring.size();
     }
 
-    int getNumAvailableForReading() const
+    // samples the producer had to throw away because the consumer fell behind
+    size_t getNumDropped() const
     {
-        return fifo.getNumReady();
+        return dropped.load(std::memory_order_relaxed);
     }
 
 private:
-    static constexpr int Capacity = 30;
-    std::array<T, Capacity> buffers;
-    juce::AbstractFifo fifo{Capacity};
+    std::vector<float> ring;
+    size_t mask = 0;
+    std::atomic<size_t> readIndex{0};
+    std::atomic<size_t> writeIndex{0};
+    std::atomic<size_t> dropped{0};
 };
 
+// one channel of the processed audio, handed to the GUI side in blocks of getSize() samples
 template <typename BlockType>
 struct SingleChannelSampleFifo
 {
@@ -106,36 +196,27 @@ struct SingleChannelSampleFifo
         prepared.set(false);
     }
 
+    // audio thread, one copy of the channel into the ring
     void update(const BlockType &buffer)
     {
         jassert(prepared.get());
         jassert(buffer.getNumChannels() > channelToUse);
-        auto *channelPtr = buffer.getReadPointer(channelToUse);
-
-        for (int i = 0; i < buffer.getNumSamples(); ++i)
-        {
-            pushNextSampleIntoFifo(channelPtr[i]);
-        }
+        fifo.write(buffer.getReadPointer(channelToUse), buffer.getNumSamples());
     }
 
-    void prepare(int bufferSize)
+    // minSamples keeps the ring big enough for a reader that takes more than one small block at a time
+    void prepare(int bufferSize, int minSamples = 0)
     {
         prepared.set(false);
         size.set(bufferSize);
-
-        bufferToFill.setSize(1,          // channel
-                             bufferSize, // num samples
-                             false,      // keepExistingContent
-                             true,       // clear extra space
-                             true);      // avoid reallocating
-        audioBufferFifo.prepare(1, bufferSize);
-        fifoIndex = 0;
+        // room for as many blocks as the old buffer queue held
+        fifo.prepare(std::max(bufferSize * Capacity, minSamples));
         prepared.set(true);
     }
     //==============================================================================
     int getNumCompleteBuffersAvailable() const
     {
-        return audioBufferFifo.getNumAvailableForReading();
+        return size.get() > 0 ? fifo.getNumReady() / size.get() : 0;
     }
     bool isPrepared() const
     {
@@ -146,33 +227,39 @@ struct SingleChannelSampleFifo
         return size.get();
     }
     //==============================================================================
+    // zero copy access for the reader, see SampleFifo::read and consume
+    SampleFifo::Span read(int maxSamples) const
+    {
+        return fifo.read(maxSamples);
+    }
+    void consume(int numSamples)
+    {
+        fifo.consume(numSamples);
+    }
+    int getNumReady() const
+    {
+        return fifo.getNumReady();
+    }
+
+    // copies the next getSize() samples into channel 0 of buf, for readers that want a buffer
     bool getAudioBuffer(BlockType &buf)
     {
-        return audioBufferFifo.pull(buf);
+        if (getNumCompleteBuffersAvailable() == 0)
+            return false;
+        auto span = fifo.read(size.get());
+        buf.setSize(1, size.get(), false, false, true);
+        buf.copyFrom(0, 0, span.first, span.firstSize);
+        buf.copyFrom(0, span.firstSize, span.second, span.secondSize);
+        fifo.consume(span.size());
+        return true;
     }
 
 private:
+    static constexpr int Capacity = 30;
     Channel channelToUse;
-    int fifoIndex = 0;
-    Fifo<BlockType> audioBufferFifo;
-    BlockType bufferToFill;
+    SampleFifo fifo;
     juce::Atomic<bool> prepared = false;
     juce::Atomic<int> size = 0;
-
-    void pushNextSampleIntoFifo(float sample)
-    {
-        if (fifoIndex == bufferToFill.getNumSamples())
-        {
-            auto ok = audioBufferFifo.push(bufferToFill);
-
-            juce::ignoreUnused(ok);
-
-            fifoIndex = 0;
-        }
-
-        bufferToFill.setSample(0, fifoIndex, sample);
-        ++fifoIndex;
-    }
 };
 
 enum Slope
@@ -190,47 +277,11 @@ struct ChainSettings
     bool lowCutBypassed{false}, highCutBypassed{false};
 };
 
-void updateCoefficients(Coefficients &old, const Coefficients &replacements)
-{
-    *old = *replacements;
-};
-
-template <int Index, typename ChainType, typename CoefficientType>
-void update(ChainType &chain, const CoefficientType &coefficients)
-{
-    updateCoefficients(chain.template get<Index>().coefficients, coefficients[Index]);
-    chain.template setBypassed<Index>(false);
-}
-
-template <typename ChainType, typename CoefficientType>
-void updateCutFilter(ChainType &leftLowCut, const CoefficientType &cutCoefficients, const Slope &lowCutSlope)
+// one section per 12 dB/oct of slope
+template <typename CoefficientType>
+void updateCutFilter(CutFilter &cutFilter, const CoefficientType &cutCoefficients, const Slope &slope)
 {
-
-    // activate
-    leftLowCut.template setBypassed<0>(true);
-    leftLowCut.template setBypassed<1>(true);
-    leftLowCut.template setBypassed<2>(true);
-    leftLowCut.template setBypassed<3>(true);
-
-    switch (lowCutSlope)
-    {
-    case Slope_48:
-    {
-        update<3>(leftLowCut, cutCoefficients);
-    }
-    case Slope_36:
-    {
-        update<2>(leftLowCut, cutCoefficients);
-    }
-    case Slope_24:
-    {
-        update<1>(leftLowCut, cutCoefficients);
-    }
-    case Slope_12:
-    {
-        update<0>(leftLowCut, cutCoefficients);
-    }
-    }
+    cutFilter.setCoefficients(cutCoefficients, (int)slope + 1);
 }
 
 auto makeLowCutFilter(const ChainSettings &chainSettings, double sampleRate)
@@ -0,0 +1,195 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "plugin_processor.hpp"
+
+// log-binned spectrum of one channel fifo, computed on its own worker thread.
+// the worker is the fifo's only reader: it slides a Hann windowed FFT over the
+// samples with 75% overlap, folds the bins into bands spaced evenly in
+// log frequency and publishes the smoothed dB values (plus peak and rms) at
+// most `publish_rate` times a second. the audio thread only writes the fifo.
+class SpectrumAnalyzer
+{
+public:
+    static constexpr int order = 11; // 2048 point FFT
+    static constexpr int size = 1 << order;
+    static constexpr int hop = size / 4;
+    static constexpr int num_bands = 96;
+    static constexpr float min_freq = 20.f;
+    static constexpr float min_db = -100.f;
+    static constexpr float publish_rate = 30.f;
+
+    struct Frame
+    {
+        std::vector<float> bands; // dB, low to high
+        float peak_db = min_db;
+        float rms_db = min_db;
+    };
+
+    ~SpectrumAnalyzer()
+    {
+        stop();
+    }
+
+    // not the audio thread, after the fifo is prepared
+    void prepare(SingleChannelSampleFifo<juce::AudioBuffer<float>> &fifo, double samplerate)
+    {
+        stop();
+        this->fifo = &fifo;
+
+        history.assign(size, 0.f);
+        fft_data.assign(2 * size, 0.f);
+        smoothed.assign(num_bands, min_db);
+
+        // band b covers [edge[b], edge[b+1]) in bins, at least one bin wide
+        float nyquist = (float)samplerate / 2.f;
+        float bin_hz = (float)samplerate / size;
+        band_edges.resize(num_bands + 1);
+        for (int b = 0; b <= num_bands; b++)
+        {
+            float freq = min_freq * std::pow(nyquist / min_freq, (float)b / num_bands);
+            band_edges[b] = std::min(size / 2, std::max(1, (int)std::lround(freq / bin_hz)));
+        }
+        for (int b = 0; b < num_bands; b++)
+            band_edges[b + 1] = std::max(band_edges[b + 1], std::min(size / 2, band_edges[b] + 1));
+
+        {
+            std::lock_guard<std::mutex> lock(published_mutex);
+            published.bands.assign(num_bands, min_db);
+            published.peak_db = min_db;
+            published.rms_db = min_db;
+            fresh = false;
+        }
+
+        running = true;
+        worker = std::thread(&SpectrumAnalyzer::run, this);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+    // message thread; copies the newest frame into `frame`, false if nothing new since the last call
+    bool get_frame(Frame &frame)
+    {
+        std::lock_guard<std::mutex> lock(published_mutex);
+        if (!fresh)
+            return false;
+        frame.bands = published.bands;
+        frame.peak_db = published.peak_db;
+        frame.rms_db = published.rms_db;
+        fresh = false;
+        return true;
+    }
+
+    // centre frequency of band b, for labelling
+    float band_freq(int b, double samplerate) const
+    {
+        float nyquist = (float)samplerate / 2.f;
+        return min_freq * std::pow(nyquist / min_freq, (b + 0.5f) / num_bands);
+    }
+
+private:
+    SingleChannelSampleFifo<juce::AudioBuffer<float>> *fifo = nullptr;
+    juce::dsp::FFT fft{order};
+    juce::dsp::WindowingFunction<float> window{(size_t)size, juce::dsp::WindowingFunction<float>::hann, false};
+
+    std::vector<float> history;  // the last `size` samples, oldest first
+    std::vector<float> fft_data; // 2 * size, as performFrequencyOnlyForwardTransform wants it
+    std::vector<float> smoothed; // dB per band, decays towards the newest frame
+    std::vector<int> band_edges;
+    float peak = 0.f;
+    double square_sum = 0.0;
+    int level_count = 0;
+
+    std::mutex published_mutex;
+    Frame published;
+    bool fresh = false;
+
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    void run()
+    {
+        using clock = std::chrono::steady_clock;
+        const auto publish_interval = std::chrono::duration<double>(1.0 / publish_rate);
+        auto last_publish = clock::now();
+        bool changed = false;
+
+        while (running)
+        {
+            while (fifo->getNumReady() >= hop)
+            {
+                consume_hop();
+                analyse();
+                changed = true;
+            }
+            if (changed && clock::now() - last_publish >= publish_interval)
+            {
+                publish();
+                last_publish = clock::now();
+                changed = false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    // shifts `hop` new samples from the fifo into the end of history
+    void consume_hop()
+    {
+        std::move(history.begin() + hop, history.end(), history.begin());
+        float *dest = history.data() + size - hop;
+
+        auto span = fifo->read(hop);
+        std::copy(span.first, span.first + span.firstSize, dest);
+        std::copy(span.second, span.second + span.secondSize, dest + span.firstSize);
+        fifo->consume(span.size());
+
+        for (int i = 0; i < hop; i++)
+        {
+            peak = std::max(peak, std::abs(dest[i]));
+            square_sum += (double)dest[i] * dest[i];
+        }
+        level_count += hop;
+    }
+
+    void analyse()
+    {
+        std::copy(history.begin(), history.end(), fft_data.begin());
+        std::fill(fft_data.begin() + size, fft_data.end(), 0.f);
+        window.multiplyWithWindowingTable(fft_data.data(), (size_t)size);
+        fft.performFrequencyOnlyForwardTransform(fft_data.data(), true);
+
+        // a full scale sine reads 0 dB: the Hann window halves the bin peak
+        const float scale = 4.f / size;
+        for (int b = 0; b < num_bands; b++)
+        {
+            float magnitude = 0.f;
+            for (int k = band_edges[b]; k < band_edges[b + 1]; k++)
+                magnitude = std::max(magnitude, fft_data[k]);
+            float db = juce::Decibels::gainToDecibels(magnitude * scale, min_db);
+            // fast attack, slow release so the display does not flicker
+            smoothed[b] = db > smoothed[b] ? db : 0.8f * smoothed[b] + 0.2f * db;
+        }
+    }
+
+    void publish()
+    {
+        std::lock_guard<std::mutex> lock(published_mutex);
+        std::copy(smoothed.begin(), smoothed.end(), published.bands.begin());
+        published.peak_db = juce::Decibels::gainToDecibels(peak, min_db);
+        published.rms_db = juce::Decibels::gainToDecibels((float)std::sqrt(square_sum / std::max(1, level_count)), min_db);
+        fresh = true;
+        peak = 0.f;
+        square_sum = 0.0;
+        level_count = 0;
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// hashed timing wheel keyed by sample index
+// entries are indices into some external population (e.g. Drops_v2::drops)
+// after allocate() nothing here touches the heap
+class TimingWheel
+{
+    std::vector<int> head;      // first entry of every slot, -1 when empty
+    std::vector<int> next;      // intrusive singly linked list, one link per entry
+    std::vector<uint64_t> due;  // sample index each entry fires at
+    uint64_t mask = 0;
+
+public:
+    // horizon_samples is how far ahead things usually get scheduled
+    // entries further out than that just wait for the wheel to come around again
+    void allocate(int num_entries, int horizon_samples)
+    {
+        uint64_t size = 1;
+        while (size < (uint64_t)horizon_samples)
+            size <<= 1;
+        head.assign(size, -1);
+        next.assign(num_entries, -1);
+        due.assign(num_entries, 0);
+        mask = size - 1;
+    }
+
+    void schedule(int entry, uint64_t sample)
+    {
+        int &slot = head[sample & mask];
+        due[entry] = sample;
+        next[entry] = slot;
+        slot = entry;
+    }
+
+    // calls fire(entry) for every entry due at `sample`
+    // fire() is free to schedule() again, even into this very slot
+    template <typename Callback>
+    void pop(uint64_t sample, Callback &&fire)
+    {
+        int &slot = head[sample & mask];
+        int entry = slot;
+        if (entry < 0)
+            return;
+
+        // detach the slot, then put back whatever belongs to a later lap
+        slot = -1;
+        while (entry >= 0)
+        {
+            int following = next[entry];
+            if (due[entry] == sample)
+            {
+                fire(entry);
+            }
+            else
+            {
+                next[entry] = slot;
+                slot = entry;
+            }
+            entry = following;
+        }
+    }
+};
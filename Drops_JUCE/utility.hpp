@@ -1,6 +1,7 @@
 #include <random>
 #include <cmath>
 #pragma once
+#include "../common/xoshiro.hpp"
 float soft_clip(float x)
 {
     if (x > 1.f)
@@ -27,32 +28,6 @@ float rand_num()
     return ((double)rand() / (RAND_MAX));
 }
 
-// random number from 0 to 1
-float rand_num_new()
-{
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-    std::uniform_real_distribution<> dist(0, 1);
-    return dist(gen);
-}
-
-// random number from 0 to end_time
-float rand_num_new(float end_time)
-{
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-    std::uniform_real_distribution<> dist(0, end_time);
-    return dist(gen);
-}
-// random number from start_time to end_time
-float rand_num_new(float start_time,float end_time)
-{
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-    std::uniform_real_distribution<> dist(start_time, end_time);
-    return dist(gen);
-}
-
 float Fast_InvSqrt(float number)
 {
     long i;
@@ -79,7 +54,7 @@ float fast_acos(float x)
         return 0.f;
 
     float negate = float(x < 0);
-    x = abs(x);
+    x = std::fabs(x); // plain abs() can resolve to the int overload
     float ret = -0.0187293;
     ret = ret * x;
     ret = ret + 0.0742610;
@@ -0,0 +1,211 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+// streams mono or interleaved float samples to disk as WAV (16/24 bit PCM or
+// 32 bit float) or as headerless raw float. samples are converted a chunk at a
+// time into a byte buffer that goes out in one write, and the WAV sizes are
+// patched in on close().
+class AudioWriter
+{
+public:
+    enum Format
+    {
+        Wav16,
+        Wav24,
+        WavFloat,
+        RawFloat, // native endian float32, no header
+    };
+
+    // dither only applies to the PCM formats, it is TPDF at one LSB
+    AudioWriter(const std::string &filename, Format format, int samplerate, int channels = 1, bool dither = false)
+        : format(format), samplerate(samplerate), channels(channels), dither(dither)
+    {
+        file.open(filename, std::ios::binary);
+        bytes.resize(chunk * bytes_per_sample());
+        scratch.resize(chunk);
+        noise.resize(chunk);
+        if (format != RawFloat)
+        {
+            write_header(0);
+        }
+    }
+
+    ~AudioWriter()
+    {
+        close();
+    }
+
+    bool is_open() const
+    {
+        return file.is_open();
+    }
+
+    void write(const float *samples, size_t n)
+    {
+        while (n > 0)
+        {
+            size_t count = std::min(n, chunk);
+            convert(samples, count);
+            file.write(bytes.data(), count * bytes_per_sample());
+            data_bytes += count * bytes_per_sample();
+            samples += count;
+            n -= count;
+        }
+    }
+
+    void write(const std::vector<float> &samples)
+    {
+        write(samples.data(), samples.size());
+    }
+
+    void close()
+    {
+        if (!file.is_open())
+            return;
+        if (format != RawFloat)
+        {
+            // RIFF chunks are word aligned, an odd data chunk (24 bit mono) gets a zero pad byte
+            if (data_bytes & 1)
+                file.put(0);
+            file.seekp(0);
+            write_header(data_bytes);
+        }
+        file.close();
+    }
+
+private:
+    static constexpr size_t chunk = 1 << 16; // samples per write
+
+    Format format;
+    int samplerate;
+    int channels;
+    bool dither;
+    std::ofstream file;
+    std::vector<char> bytes;
+    std::vector<int32_t> scratch;
+    std::vector<float> noise;
+    uint64_t data_bytes = 0;
+    uint32_t noise_counter = 0;
+
+    int bytes_per_sample() const
+    {
+        switch (format)
+        {
+        case Wav16:
+            return 2;
+        case Wav24:
+            return 3;
+        default:
+            return 4;
+        }
+    }
+
+    // counter based hash, so the noise loop has no carried state and vectorizes
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    void convert(const float *samples, size_t n)
+    {
+        if (format == RawFloat || format == WavFloat)
+        {
+            std::memcpy(bytes.data(), samples, n * sizeof(float));
+            return;
+        }
+
+        const float scale = format == Wav16 ? 32767.f : 8388607.f;
+
+        // triangular noise one LSB wide: the difference of two uniforms in [0, 1)
+        float *tpdf = noise.data();
+        if (dither)
+        {
+            const uint32_t base = noise_counter;
+            for (size_t i = 0; i < n; i++)
+            {
+                uint32_t k = base + 2 * (uint32_t)i;
+                tpdf[i] = (hash(k) >> 8) * (1.f / 16777216.f) - (hash(k + 1) >> 8) * (1.f / 16777216.f);
+            }
+            noise_counter += 2 * (uint32_t)n;
+        }
+        else
+        {
+            std::fill(tpdf, tpdf + n, 0.f);
+        }
+
+        int32_t *quantized = scratch.data();
+        for (size_t i = 0; i < n; i++)
+        {
+            float x = samples[i] * scale + tpdf[i];
+            x = std::min(std::max(x, -scale - 1.f), scale);
+            quantized[i] = (int32_t)std::lrintf(x);
+        }
+
+        // little endian packing
+        char *out = bytes.data();
+        if (format == Wav16)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                out[2 * i] = (char)(quantized[i] & 0xff);
+                out[2 * i + 1] = (char)((quantized[i] >> 8) & 0xff);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                out[3 * i] = (char)(quantized[i] & 0xff);
+                out[3 * i + 1] = (char)((quantized[i] >> 8) & 0xff);
+                out[3 * i + 2] = (char)((quantized[i] >> 16) & 0xff);
+            }
+        }
+    }
+
+    void put16(uint16_t v)
+    {
+        char b[2] = {(char)(v & 0xff), (char)(v >> 8)};
+        file.write(b, 2);
+    }
+
+    void put32(uint32_t v)
+    {
+        char b[4] = {(char)(v & 0xff), (char)((v >> 8) & 0xff), (char)((v >> 16) & 0xff), (char)(v >> 24)};
+        file.write(b, 4);
+    }
+
+    void write_header(uint64_t data_size)
+    {
+        uint16_t bits = bytes_per_sample() * 8;
+        uint16_t block_align = channels * bytes_per_sample();
+        // sizes past 4GB get clamped, most readers then just read to the end of the file
+        uint32_t size = (uint32_t)std::min<uint64_t>(data_size, 0xffffffffu - 37);
+        // the data chunk's own size leaves the pad byte out, the RIFF size counts it
+        uint32_t pad = size & 1;
+
+        file.write("RIFF", 4);
+        put32(36 + size + pad);
+        file.write("WAVE", 4);
+        file.write("fmt ", 4);
+        put32(16);
+        put16(format == WavFloat ? 3 : 1); // 3 is IEEE float, 1 is PCM
+        put16(channels);
+        put32(samplerate);
+        put32(samplerate * block_align);
+        put16(block_align);
+        put16(bits);
+        file.write("data", 4);
+        put32(size);
+    }
+};
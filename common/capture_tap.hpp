@@ -0,0 +1,124 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_writer.hpp"
+
+// opt-in recording of a signal from the audio thread.
+// push() drops samples into a preallocated single-producer/single-consumer
+// ring and a background thread drains it to a float WAV. while capture is off
+// push() is one atomic load; while it is on it never allocates or blocks, and
+// samples that do not fit are counted and thrown away.
+class CaptureTap
+{
+public:
+    // capacity is rounded up to a power of two, the default is ~5 s at 48 kHz
+    explicit CaptureTap(size_t capacity = 1 << 18)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        this->capacity = size;
+    }
+
+    ~CaptureTap()
+    {
+        stop();
+    }
+
+    CaptureTap(const CaptureTap &) = delete;
+    CaptureTap &operator=(const CaptureTap &) = delete;
+
+    // audio thread
+    void push(float sample)
+    {
+        if (!enabled.load(std::memory_order_acquire))
+            return;
+
+        size_t w = write_index.load(std::memory_order_relaxed);
+        if (w - read_index.load(std::memory_order_acquire) == capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring[w & (capacity - 1)] = sample;
+        write_index.store(w + 1, std::memory_order_release);
+    }
+
+    // not the audio thread; starting while already running does nothing
+    void start(const std::string &filename, int samplerate)
+    {
+        if (running)
+            return;
+
+        // the ring is allocated once and kept, a push racing with stop() still lands in valid memory
+        if (ring.empty())
+            ring.resize(capacity);
+        read_index.store(0);
+        write_index.store(0);
+        dropped.store(0);
+
+        running = true;
+        worker = std::thread(&CaptureTap::run, this, filename, samplerate);
+        enabled.store(true, std::memory_order_release);
+    }
+
+    // not the audio thread; writes out what is left and closes the file
+    void stop()
+    {
+        enabled.store(false, std::memory_order_release);
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+    bool is_capturing() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // samples lost because the writer could not keep up
+    size_t dropped_samples() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t capacity;
+    std::vector<float> ring;
+    std::atomic<size_t> read_index{0};
+    std::atomic<size_t> write_index{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    void run(std::string filename, int samplerate)
+    {
+        AudioWriter writer(filename, AudioWriter::WavFloat, samplerate);
+        while (running)
+        {
+            drain(writer);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        drain(writer);
+    }
+
+    void drain(AudioWriter &writer)
+    {
+        size_t r = read_index.load(std::memory_order_relaxed);
+        size_t w = write_index.load(std::memory_order_acquire);
+        while (r != w)
+        {
+            // at most two contiguous pieces, before and after the wrap
+            size_t start = r & (capacity - 1);
+            size_t n = std::min(w - r, capacity - start);
+            writer.write(&ring[start], n);
+            r += n;
+        }
+        read_index.store(r, std::memory_order_release);
+    }
+};
@@ -0,0 +1,372 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// audio thread real-time safety checks for debug and test builds.
+// build with REALTIME_GUARD defined and everything a RealtimeScope encloses
+// (every processBlock opens one) is watched: allocating, freeing, locking a
+// mutex, waiting, sleeping and blocking reads and writes count as violations.
+// each offending call site, the first few return addresses, gets a counter.
+// RealtimeGuard::violations() is there for a test to check, report() prints
+// the sites with their stacks, and the program prints it at exit when there
+// was anything. with REALTIME_GUARD_ABORT=1 in the environment the first
+// violation aborts instead, so a test run stops right at the call.
+// the hooks replace malloc (glibc) or operator new (elsewhere) and, on
+// linux, a few libc calls for the whole program, so include this from one
+// translation unit only, the plugin's main. they win in an executable (the
+// Standalone build or a test host); in a plugin loaded by a host, the host's
+// own malloc wins.
+// without REALTIME_GUARD all of this is empty and costs nothing.
+//
+// this is the one copy every plugin includes. Drops_JUCE turns it on with
+// cmake -DDROPS_REALTIME_GUARD=ON; for the plugins built from their own
+// projects (karplus_strong, quasi_band_limited) add REALTIME_GUARD=1 to the
+// preprocessor definitions and link libdl, and export the executable's
+// symbols (-rdynamic) so the report can name functions.
+// realtime_guard_check/ is a small host that exercises all of it.
+
+#ifdef REALTIME_GUARD
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <new>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GNUC__)
+// static TLS: the hooks read it from inside malloc, where lazily allocated TLS would recurse
+#define REALTIME_GUARD_TLS __attribute__((tls_model("initial-exec")))
+#else
+#define REALTIME_GUARD_TLS
+#endif
+
+// one offending call site
+struct RealtimeGuardSite
+{
+    std::atomic<uint64_t> key{0}; // hash of kind and stack, 0 is free
+    std::atomic<uint64_t> count{0};
+    int kind = 0;
+    int frames = 0;
+    void *stack[6];
+};
+
+class RealtimeGuard
+{
+public:
+    enum Kind
+    {
+        Allocation,
+        Deallocation,
+        Lock,
+        Wait,
+        Sleep,
+        Syscall,
+        num_kinds
+    };
+
+    static constexpr int max_sites = 512;
+    static constexpr int stack_depth = sizeof(RealtimeGuardSite::stack) / sizeof(void *);
+
+    // called by the hooks on every thread
+    static bool active()
+    {
+        return depth > 0 && !in_hook;
+    }
+
+    static void violation(Kind kind)
+    {
+        // whatever the bookkeeping below calls is not the audio code's fault
+        in_hook = true;
+        void *frames[stack_depth + 2];
+        int n = backtrace(frames, stack_depth + 2);
+        // frames[0] is here, frames[1] the hook
+        void **stack = frames + std::min(n, 2);
+        n = std::max(0, n - 2);
+
+        uint64_t key = (uint64_t)kind + 1;
+        for (int i = 0; i < n; i++)
+            key = (key ^ (uint64_t)(uintptr_t)stack[i]) * 0x100000001b3ull;
+        if (key == 0)
+            key = 1;
+
+        total.fetch_add(1, std::memory_order_relaxed);
+        record(key, kind, stack, n);
+
+        if (abort_on_violation())
+        {
+            dprintf(2, "realtime guard: %s on the audio thread\n", name(kind));
+            backtrace_symbols_fd(stack, n, 2);
+            std::abort();
+        }
+        in_hook = false;
+    }
+
+    // how many violations since the start or the last reset(), any thread
+    static uint64_t violations()
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    // not the audio thread; forgets all sites
+    static void reset()
+    {
+        for (auto &site : sites)
+        {
+            site.count.store(0, std::memory_order_relaxed);
+            site.key.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+    }
+
+    // not the audio thread; writes every site, its count and its stack to fd
+    static void report(int fd = 2)
+    {
+        in_hook = true;
+        dprintf(fd, "realtime guard: %llu violation(s)\n", (unsigned long long)violations());
+        for (auto &site : sites)
+        {
+            uint64_t count = site.count.load(std::memory_order_relaxed);
+            if (site.key.load(std::memory_order_acquire) == 0 || count == 0)
+                continue;
+            dprintf(fd, "%llu x %s at\n", (unsigned long long)count, name(site.kind));
+            backtrace_symbols_fd(site.stack, site.frames, fd);
+        }
+        in_hook = false;
+    }
+
+private:
+    friend class RealtimeScope;
+
+    // prints the sites when the program ends, if there were any
+    struct ExitReport
+    {
+        ~ExitReport()
+        {
+            if (violations() > 0)
+                report();
+        }
+    };
+
+    static inline thread_local int depth REALTIME_GUARD_TLS = 0;
+    static inline thread_local bool in_hook REALTIME_GUARD_TLS = false;
+    static inline RealtimeGuardSite sites[max_sites];
+    static inline std::atomic<uint64_t> total{0};
+    static inline ExitReport exit_report;
+
+    static const char *name(int kind)
+    {
+        static const char *names[num_kinds] = {"allocation", "deallocation", "lock", "wait", "sleep", "syscall"};
+        return names[kind];
+    }
+
+    static bool abort_on_violation()
+    {
+        static const bool enabled = [] {
+            const char *value = std::getenv("REALTIME_GUARD_ABORT");
+            return value != nullptr && value[0] == '1';
+        }();
+        return enabled;
+    }
+
+    // open addressing, a slot is claimed once and keeps its key until reset()
+    static void record(uint64_t key, Kind kind, void **stack, int n)
+    {
+        for (int probe = 0; probe < max_sites; probe++)
+        {
+            RealtimeGuardSite &site = sites[(key + probe) % max_sites];
+            uint64_t expected = 0;
+            if (site.key.compare_exchange_strong(expected, key, std::memory_order_acq_rel))
+            {
+                site.kind = kind;
+                site.frames = std::min(n, stack_depth);
+                std::memcpy(site.stack, stack, site.frames * sizeof(void *));
+            }
+            else if (expected != key)
+                continue;
+            site.count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // table full, the total still counts it
+    }
+};
+
+// marks the enclosing block as audio thread code, scopes nest
+class RealtimeScope
+{
+public:
+    RealtimeScope() { RealtimeGuard::depth++; }
+    ~RealtimeScope() { RealtimeGuard::depth--; }
+    RealtimeScope(const RealtimeScope &) = delete;
+    RealtimeScope &operator=(const RealtimeScope &) = delete;
+};
+
+// the next definition of a libc function, looked up once
+template <typename Function>
+Function realtime_guard_next(Function &cache, const char *name)
+{
+    if (cache == nullptr)
+        cache = (Function)dlsym(RTLD_NEXT, name);
+    return cache;
+}
+
+#if defined(__GLIBC__)
+// glibc exports its allocator under these names too, so malloc itself can be
+// replaced without dlsym (which allocates)
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+extern "C" void *__libc_memalign(size_t, size_t);
+extern "C" void __libc_free(void *);
+
+extern "C" void *malloc(size_t size)
+{
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return 22; // EINVAL
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    void *result = __libc_memalign(alignment, size);
+    if (result == nullptr && size != 0)
+        return 12; // ENOMEM
+    *pointer = result;
+    return 0;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void free(void *pointer)
+{
+    if (pointer != nullptr && RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Deallocation);
+    __libc_free(pointer);
+}
+#else
+// no portable way under malloc, so catch what C++ allocates
+void *operator new(size_t size)
+{
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Allocation);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    if (pointer != nullptr && RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Deallocation);
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+#endif
+
+#if defined(__linux__)
+// an executable's definitions take precedence over libc's here, not so on macOS
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    static int (*next)(pthread_mutex_t *) = nullptr;
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Lock);
+    return realtime_guard_next(next, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t *condition, pthread_mutex_t *mutex)
+{
+    static int (*next)(pthread_cond_t *, pthread_mutex_t *) = nullptr;
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Wait);
+    return realtime_guard_next(next, "pthread_cond_wait")(condition, mutex);
+}
+
+extern "C" int nanosleep(const struct timespec *duration, struct timespec *remaining)
+{
+    static int (*next)(const struct timespec *, struct timespec *) = nullptr;
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Sleep);
+    return realtime_guard_next(next, "nanosleep")(duration, remaining);
+}
+
+extern "C" ssize_t read(int fd, void *data, size_t size)
+{
+    static ssize_t (*next)(int, void *, size_t) = nullptr;
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Syscall);
+    return realtime_guard_next(next, "read")(fd, data, size);
+}
+
+extern "C" ssize_t write(int fd, const void *data, size_t size)
+{
+    static ssize_t (*next)(int, const void *, size_t) = nullptr;
+    if (RealtimeGuard::active())
+        RealtimeGuard::violation(RealtimeGuard::Syscall);
+    return realtime_guard_next(next, "write")(fd, data, size);
+}
+#endif
+
+#else
+
+class RealtimeGuard
+{
+public:
+    static uint64_t violations() { return 0; }
+    static void reset() {}
+    static void report(int = 2) {}
+};
+
+class RealtimeScope
+{
+public:
+    RealtimeScope() {}
+};
+
+#endif
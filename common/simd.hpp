@@ -0,0 +1,187 @@
+#pragma once
+#include <cmath>
+
+// four float lanes and a matching lane mask
+// SSE2 on x86, NEON on arm, plain arrays everywhere else
+// only the handful of operations the drop kernels need
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+struct m4
+{
+    __m128 v;
+};
+
+struct f4
+{
+    __m128 v;
+
+    static f4 load(const float *p) { return {_mm_load_ps(p)}; }
+    static f4 set(float x) { return {_mm_set1_ps(x)}; }
+    void store(float *p) const { _mm_store_ps(p, v); }
+};
+
+inline f4 operator+(f4 a, f4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline f4 operator-(f4 a, f4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline f4 operator*(f4 a, f4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline f4 min(f4 a, f4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline f4 max(f4 a, f4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline f4 sqrt(f4 a) { return {_mm_sqrt_ps(a.v)}; }
+inline m4 operator<(f4 a, f4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline m4 operator>=(f4 a, f4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline m4 operator&(m4 a, m4 b) { return {_mm_and_ps(a.v, b.v)}; }
+// mask ? a : b
+inline f4 select(m4 m, f4 a, f4 b) { return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))}; }
+// mask ? a : 0
+inline f4 select(m4 m, f4 a) { return {_mm_and_ps(m.v, a.v)}; }
+// lanes move up by one, the top lane falls off and x comes in at lane 0
+inline f4 shift_in(f4 a, float x) { return {_mm_move_ss(_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(a.v), 4)), _mm_set_ss(x))}; }
+
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+struct m4
+{
+    uint32x4_t v;
+};
+
+struct f4
+{
+    float32x4_t v;
+
+    static f4 load(const float *p) { return {vld1q_f32(p)}; }
+    static f4 set(float x) { return {vdupq_n_f32(x)}; }
+    void store(float *p) const { vst1q_f32(p, v); }
+};
+
+inline f4 operator+(f4 a, f4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline f4 operator-(f4 a, f4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline f4 operator*(f4 a, f4 b) { return {vmulq_f32(a.v, b.v)}; }
+inline f4 min(f4 a, f4 b) { return {vminq_f32(a.v, b.v)}; }
+inline f4 max(f4 a, f4 b) { return {vmaxq_f32(a.v, b.v)}; }
+#if defined(__aarch64__)
+inline f4 sqrt(f4 a) { return {vsqrtq_f32(a.v)}; }
+#else
+inline f4 sqrt(f4 a)
+{
+    // armv7 has no vector sqrt, two newton steps on the estimate are plenty here
+    float32x4_t r = vrsqrteq_f32(a.v);
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a.v, r), r));
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a.v, r), r));
+    // sqrt(0) would come out as 0 * inf
+    uint32x4_t zero = vceqq_f32(a.v, vdupq_n_f32(0.f));
+    return {vbslq_f32(zero, a.v, vmulq_f32(a.v, r))};
+}
+#endif
+inline m4 operator<(f4 a, f4 b) { return {vcltq_f32(a.v, b.v)}; }
+inline m4 operator>=(f4 a, f4 b) { return {vcgeq_f32(a.v, b.v)}; }
+inline m4 operator&(m4 a, m4 b) { return {vandq_u32(a.v, b.v)}; }
+inline f4 select(m4 m, f4 a, f4 b) { return {vbslq_f32(m.v, a.v, b.v)}; }
+inline f4 select(m4 m, f4 a) { return {vreinterpretq_f32_u32(vandq_u32(m.v, vreinterpretq_u32_f32(a.v)))}; }
+inline f4 shift_in(f4 a, float x) { return {vextq_f32(vdupq_n_f32(x), a.v, 3)}; }
+
+#else
+
+struct m4
+{
+    bool v[4];
+};
+
+struct f4
+{
+    float v[4];
+
+    static f4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    static f4 set(float x) { return {{x, x, x, x}}; }
+    void store(float *p) const
+    {
+        for (int i = 0; i < 4; i++)
+            p[i] = v[i];
+    }
+};
+
+// everything below is just the obvious loop over the four lanes
+inline f4 operator+(f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] + b.v[i];
+    return r;
+}
+inline f4 operator-(f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] - b.v[i];
+    return r;
+}
+inline f4 operator*(f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] * b.v[i];
+    return r;
+}
+inline f4 min(f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = std::fmin(a.v[i], b.v[i]);
+    return r;
+}
+inline f4 max(f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = std::fmax(a.v[i], b.v[i]);
+    return r;
+}
+inline f4 sqrt(f4 a)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = std::sqrt(a.v[i]);
+    return r;
+}
+inline m4 operator<(f4 a, f4 b)
+{
+    m4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] < b.v[i];
+    return r;
+}
+inline m4 operator>=(f4 a, f4 b)
+{
+    m4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] >= b.v[i];
+    return r;
+}
+inline m4 operator&(m4 a, m4 b)
+{
+    m4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = a.v[i] && b.v[i];
+    return r;
+}
+inline f4 select(m4 m, f4 a, f4 b)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+    return r;
+}
+inline f4 select(m4 m, f4 a)
+{
+    f4 r;
+    for (int i = 0; i < 4; i++)
+        r.v[i] = m.v[i] ? a.v[i] : 0.f;
+    return r;
+}
+inline f4 shift_in(f4 a, float x)
+{
+    return {{x, a.v[0], a.v[1], a.v[2]}};
+}
+
+#endif
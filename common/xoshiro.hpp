@@ -0,0 +1,83 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+// xoshiro128+ by Blackman and Vigna, seeded through splitmix64
+// no syscalls and no allocation, so it is fine on the audio thread
+// give every processor its own, nothing in here is thread safe
+class Xoshiro
+{
+    uint32_t s[4];
+
+    static uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+public:
+    // seeding from the OS happens once, here, never per sample
+    Xoshiro() : Xoshiro(((uint64_t)std::random_device{}() << 32) ^ std::random_device{}()) {}
+    explicit Xoshiro(uint64_t seed) { this->seed(seed); }
+
+    void seed(uint64_t seed)
+    {
+        for (auto &word : s)
+        {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word = (uint32_t)((z ^ (z >> 31)) >> 32);
+        }
+    }
+
+    uint32_t next()
+    {
+        uint32_t result = s[0] + s[3];
+        uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    // random number from 0 to 1 (1 excluded), the low bits of xoshiro128+ are weak so use the top 24
+    float uniform()
+    {
+        return (next() >> 8) * (1.f / 16777216.f);
+    }
+    // random number from 0 to end
+    float uniform(float end)
+    {
+        return uniform() * end;
+    }
+    // random number from start to end
+    float uniform(float start, float end)
+    {
+        return start + (end - start) * uniform();
+    }
+
+    void fill_uniform(float *out, int n, float start = 0.f, float end = 1.f)
+    {
+        for (int i = 0; i < n; i++)
+            out[i] = uniform(start, end);
+    }
+
+    // Box-Muller, two values per pair of uniforms
+    void fill_gaussian(float *out, int n, float mean = 0.f, float deviation = 1.f)
+    {
+        for (int i = 0; i < n; i += 2)
+        {
+            float u1 = 1.f - uniform(); // (0, 1], log(0) is no good
+            float u2 = uniform();
+            float r = deviation * std::sqrt(-2.f * std::log(u1));
+            float a = 2.f * float(M_PI) * u2;
+            out[i] = mean + r * std::cos(a);
+            if (i + 1 < n)
+                out[i + 1] = mean + r * std::sin(a);
+        }
+    }
+};
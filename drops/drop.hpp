@@ -4,6 +4,7 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include "../common/capture_tap.hpp"
 
 class Drop
 {
@@ -43,20 +44,47 @@ public:
         this->t2_end = this->t_end + delta_2;
     };
 
-    std::vector<float> res;
+    // set this to record what sample_at produces, several drops can share one tap
+    CaptureTap *tap = nullptr;
     float sample_at(float time_stamp)
     {
-        if (time_stamp < t_init)
+        if (!in_window(time_stamp))
         {
             return 0.f;
         }
 
+        float pressure = pressure_at(time_stamp);
+        if (tap != nullptr)
+        {
+            tap->push(pressure);
+        }
+        return pressure;
+    }
+
+    // inside [t_init, t_end] or [t2_start, t2_end]
+    bool in_window(float time_stamp) const
+    {
+        if (time_stamp < t_init)
+        {
+            return false;
+        }
+
         if (time_stamp > t_end && time_stamp < t2_start)
         {
-            return 0.f;
+            return false;
         }
 
         if (time_stamp > t2_end)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // same as sample_at, but leaves the drop alone so any number of threads can call it
+    float pressure_at(float time_stamp) const
+    {
+        if (!in_window(time_stamp))
         {
             return 0.f;
         }
@@ -75,7 +103,37 @@ public:
             pressure = 1.7 * a_1 * exp(-m * (_t - q)) * sin(f * (_t - q));
         }
 
-        res.push_back(pressure);
         return pressure;
     }
+
+    // adds this drop into out[i] for every times[i] inside one of its windows
+    // times must be ascending. only the samples that overlap a window get touched,
+    // so a block costs O(active samples) instead of O(samples)
+    void render(const float *times, float *out, size_t n) const
+    {
+        const float *end = times + n;
+
+        // pressure wave: t_init <= t, t < t2_start and t <= t_end
+        size_t first = std::lower_bound(times, end, t_init) - times;
+        size_t last = std::min(std::lower_bound(times, end, t2_start), std::upper_bound(times, end, t_end)) - times;
+        const double scale = rho_0 * c * ke / M_PI;
+        for (size_t i = first; i < last; i++)
+        {
+            float _t = times[i];
+            float upper = (c * c * _t * _t - H * H + x_0 * x_0 - a * a);
+            float lower = (2 * x_0 * sqrtf(c * c * _t * _t - H * H));
+            float pressure = scale * acos(upper / lower);
+            out[i] += pressure;
+        }
+
+        // ringing: t2_start <= t <= t2_end
+        first = std::lower_bound(times, end, t2_start) - times;
+        last = std::upper_bound(times, end, t2_end) - times;
+        for (size_t i = first; i < last; i++)
+        {
+            float _t = times[i];
+            float pressure = 1.7 * a_1 * exp(-m * (_t - q)) * sin(f * (_t - q));
+            out[i] += pressure;
+        }
+    }
 };
@@ -4,16 +4,76 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
 #include "drop.hpp"
+#include "../common/audio_writer.hpp"
 using namespace std;
 
-int main()
+// every output sample is the sum over all drops in index order, whichever
+// thread computes it, so the result is bit-identical for any thread count.
+// threads grab fixed-size chunks of samples off a shared counter; each chunk is
+// that thread's accumulation buffer and lands in its own slot of result.
+// drops only write the parts of a chunk that overlap their windows.
+void render(const vector<Drop> &drops, const vector<float> &times, vector<float> &result, unsigned num_threads)
+{
+    const size_t chunk = 4096;
+    const size_t num_chunks = (times.size() + chunk - 1) / chunk;
+    result.assign(times.size(), 0.f);
+
+    atomic<size_t> next_chunk{0};
+    auto work = [&]()
+    {
+        for (size_t k = next_chunk++; k < num_chunks; k = next_chunk++)
+        {
+            size_t begin = k * chunk;
+            size_t n = min(times.size(), begin + chunk) - begin;
+            for (size_t i = 0; i < drops.size(); i++)
+            {
+                drops[i].render(&times[begin], &result[begin], n);
+            }
+        }
+    };
+
+    num_threads = max(1u, num_threads);
+    vector<thread> workers;
+    for (unsigned i = 1; i < num_threads; i++)
+    {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// usage: drops [threads] [output] [capture]
+// threads defaults to one per core, output to test01.wav (24 bit, dithered)
+// an output ending in .raw gets headerless float32 instead
+// capture, if given, also records what the first drop produces on its own
+// through its tap, as a float WAV of only the samples inside its windows
+int main(int argc, char **argv)
 {
     vector<Drop> drops;
     vector<float> result;
 
-    ofstream myfile;
-    myfile.open("test01.txt");
+    unsigned num_threads = thread::hardware_concurrency();
+    if (argc > 1)
+    {
+        // atoi gives 0 for anything that isn't a number, so that is rejected too
+        int requested = atoi(argv[1]);
+        if (requested < 1)
+        {
+            cerr << "usage: " << argv[0] << " [threads] [output] [capture]" << endl
+                 << "threads must be at least 1" << endl;
+            return 1;
+        }
+        num_threads = requested;
+    }
+    string filename = argc > 2 ? argv[2] : "test01.wav";
+    bool raw = filename.size() > 4 && filename.substr(filename.size() - 4) == ".raw";
 
     for (int _ = 0; _ < 1000; _++)
     {
@@ -23,15 +83,27 @@ int main()
     float t_init = 0.00f;
     float t_end = 1.f;
 
+    // the time stamps are accumulated serially so every thread sees exactly the same floats
+    vector<float> times;
     for (float t = t_init; t < t_end; t += 1. / 44100.f)
     {
-        float res = 0.0f;
+        times.push_back(t);
+    }
 
-        for (int i = 0; i < drops.size(); i++)
+    render(drops, times, result, num_threads);
+
+    if (argc > 3)
+    {
+        // sample_at is the single-threaded path that feeds the tap
+        CaptureTap tap(times.size());
+        tap.start(argv[3], 44100);
+        drops[0].tap = &tap;
+        for (float t : times)
         {
-            res += drops[i].sample_at(t);
+            drops[0].sample_at(t);
         }
-        result.push_back(res);
+        drops[0].tap = nullptr;
+        tap.stop();
     }
 
     auto max_val = *std::max_element(result.begin(), result.end(), [](float a, float b)
@@ -40,11 +112,11 @@ int main()
     for (auto &elem : result)
     {
         elem /= max_val;
-        myfile << elem << endl;
-        cout << elem << endl;
     }
 
-    myfile.close();
+    AudioWriter writer(filename, raw ? AudioWriter::RawFloat : AudioWriter::Wav24, 44100, 1, true);
+    writer.write(result);
+    writer.close();
 
     return 0;
 }
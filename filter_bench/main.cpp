@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <complex>
+#include "../karplus_strong/filter.hpp"
+using namespace std;
+
+// times the single channel filters of karplus_strong/filter.hpp, the
+// per-sample versions against their block process() paths, for block sizes
+// 16 to 4096, and checks that both give the same output up to rounding.
+// then TptStateVariableFilter against StateVariableFilter::step(), with the
+// cutoff held for a block and with it moving every sample.
+// last, the lowpass BiquadTable hands BiquadFilter against the cookbook
+// formulas: the response next to the exact one, and the cost of retuning
+// every sample either way.
+// prints ns per sample and the worst deviation; returns 1 if a deviation goes
+// over its tolerance.
+//
+// build: g++ -std=c++17 -O2 -o filter_bench filter_bench/main.cpp
+
+const int total = 1 << 22; // samples filtered per measurement
+const int sizes[] = {16, 64, 256, 1024, 4096};
+const float samplerate = 44100.f;
+
+// process() runs the same recursion in another order, the block tables are rounded to float
+const double biquad_tolerance = 1e-5;
+const double svf_tolerance = 1e-6;
+// dB the table may lose on top of what rounding the exact coefficients to float loses
+const double table_tolerance = 0.25;
+
+int failures = 0;
+volatile float sink; // keeps the timed loops from being thrown away
+
+// white noise in [-1, 1), the same for every run
+vector<float> noise(int n)
+{
+    vector<float> x(n);
+    uint32_t state = 1;
+    for (auto &v : x)
+    {
+        state = state * 1664525u + 1013904223u;
+        v = (state >> 8) * (2.f / 16777216.f) - 1.f;
+    }
+    return x;
+}
+
+// ns per sample for render(block, n) called on consecutive blocks of `size`
+template <typename Render>
+double time_blocks(const vector<float> &in, vector<float> &out, int size, Render &&render)
+{
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < total; i += size)
+    {
+        render(&in[i], &out[i], size);
+    }
+    auto end = chrono::steady_clock::now();
+    sink = out[total - 1];
+    return chrono::duration<double, nano>(end - begin).count() / total;
+}
+
+// Audio EQ Cookbook lowpass, c = {b0, b1, b2, a1, a2} normalized, in T's precision
+template <typename T>
+void cookbook_lpf(T f0, T Q, T rate, T (&c)[5])
+{
+    T w0 = 2 * T(M_PI) * f0 / rate;
+    T alpha = sin(w0) / (2 * Q);
+    T a0 = 1 + alpha;
+    c[0] = c[2] = (1 - cos(w0)) / 2 / a0;
+    c[1] = (1 - cos(w0)) / a0;
+    c[3] = -2 * cos(w0) / a0;
+    c[4] = (1 - alpha) / a0;
+}
+
+// |H| at f in dB
+template <typename T>
+double response_db(const T (&c)[5], double f, double rate)
+{
+    complex<double> z1 = polar(1., -2 * M_PI * f / rate), z2 = z1 * z1;
+    return 20 * log10(abs(((double)c[0] + (double)c[1] * z1 + (double)c[2] * z2) / (1. + (double)c[3] * z1 + (double)c[4] * z2)));
+}
+
+double deviation(const vector<float> &a, const vector<float> &b)
+{
+    double worst = 0.;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        worst = max(worst, (double)abs(a[i] - b[i]));
+    }
+    return worst;
+}
+
+int main()
+{
+    const vector<float> in = noise(total);
+    vector<float> scalar(total), block(total);
+
+    // the plugin's defaults: note 40, q 0.7
+    const float wct = 40.f / 127.f, q = 0.7f;
+
+    printf("ns per sample, %d samples\n", total);
+    printf("%6s %22s %22s\n", "block", "biquad scalar/block", "svf scalar/block");
+    double biquad_worst = 0., svf_worst = 0.;
+    for (int size : sizes)
+    {
+        BiquadFilter<float> biquad_scalar, biquad_block;
+        biquad_scalar.lpf(1000.f, 0.7f, samplerate);
+        biquad_block.lpf(1000.f, 0.7f, samplerate);
+        double biquad_scalar_ns = time_blocks(in, scalar, size, [&](const float *x, float *y, int n)
+                                              {
+                                                  for (int i = 0; i < n; i++)
+                                                      y[i] = biquad_scalar(x[i]);
+                                              });
+        double biquad_block_ns = time_blocks(in, block, size, [&](const float *x, float *y, int n)
+                                             { biquad_block.process(x, y, n); });
+        biquad_worst = max(biquad_worst, deviation(scalar, block));
+
+        StateVariableFilter<float> svf_scalar, svf_block;
+        double svf_scalar_ns = time_blocks(in, scalar, size, [&](const float *x, float *y, int n)
+                                           {
+                                               for (int i = 0; i < n; i++)
+                                               {
+                                                   svf_scalar.step(x[i], wct, q);
+                                                   y[i] = svf_scalar.low();
+                                               }
+                                           });
+        double svf_block_ns = time_blocks(in, block, size, [&](const float *x, float *y, int n)
+                                          { svf_block.process(x, y, n, wct, q); });
+        svf_worst = max(svf_worst, deviation(scalar, block));
+
+        printf("%6d %13.2f / %-6.2f %13.2f / %.2f\n", size, biquad_scalar_ns, biquad_block_ns, svf_scalar_ns, svf_block_ns);
+    }
+
+    printf("worst deviation: biquad %.3g (tolerance %.3g), svf %.3g (tolerance %.3g)\n",
+           biquad_worst, biquad_tolerance, svf_worst, svf_tolerance);
+    failures += biquad_worst > biquad_tolerance;
+    failures += svf_worst > svf_tolerance;
+
+    // mtof(40), what the plugin's ZDF switch turns note 40 into
+    const float cutoff = 440.f * pow(2.f, (40.f - 69.f) / 12.f);
+    printf("\ncutoff held for the block\n");
+    printf("%6s %12s %12s %12s\n", "block", "svf step", "tpt step", "tpt process");
+    double tpt_worst = 0.;
+    for (int size : sizes)
+    {
+        StateVariableFilter<float> svf;
+        double svf_ns = time_blocks(in, scalar, size, [&](const float *x, float *y, int n)
+                                    {
+                                        for (int i = 0; i < n; i++)
+                                        {
+                                            svf.step(x[i], wct, q);
+                                            y[i] = svf.low();
+                                        }
+                                    });
+
+        TptStateVariableFilter<float> tpt_step, tpt_block;
+        tpt_step.prepare(samplerate);
+        tpt_block.prepare(samplerate);
+        double step_ns = time_blocks(in, scalar, size, [&](const float *x, float *y, int n)
+                                     {
+                                         for (int i = 0; i < n; i++)
+                                         {
+                                             tpt_step.step(x[i], cutoff, q);
+                                             y[i] = tpt_step.low();
+                                         }
+                                     });
+        double process_ns = time_blocks(in, block, size, [&](const float *x, float *y, int n)
+                                        { tpt_block.process(x, y, n, cutoff, q); });
+        tpt_worst = max(tpt_worst, deviation(scalar, block));
+
+        printf("%6d %12.2f %12.2f %12.2f\n", size, svf_ns, step_ns, process_ns);
+    }
+    // the same arithmetic in the same order
+    printf("worst deviation: tpt process from step %.3g (tolerance 0)\n", tpt_worst);
+    failures += tpt_worst > 0.;
+
+    // a sweep over most of the range, a new cutoff every sample
+    vector<float> sweep(total);
+    for (int i = 0; i < total; i++)
+    {
+        sweep[i] = 0.5f + 0.45f * sin(2.f * (float)M_PI * i / 44100.f);
+    }
+    StateVariableFilter<float> svf;
+    double svf_ns = time_blocks(in, scalar, 256, [&](const float *x, float *y, int n)
+                                {
+                                    const float *w = &sweep[x - in.data()];
+                                    for (int i = 0; i < n; i++)
+                                    {
+                                        svf.step(x[i], w[i], q);
+                                        y[i] = svf.low();
+                                    }
+                                });
+    TptStateVariableFilter<float> tpt;
+    tpt.prepare(samplerate);
+    double tpt_ns = time_blocks(in, scalar, 256, [&](const float *x, float *y, int n)
+                                {
+                                    const float *w = &sweep[x - in.data()];
+                                    for (int i = 0; i < n; i++)
+                                    {
+                                        tpt.step(x[i], w[i] * 0.5f * samplerate, q);
+                                        y[i] = tpt.low();
+                                    }
+                                });
+    printf("\ncutoff moving every sample: svf step %.2f, tpt step %.2f\n", svf_ns, tpt_ns);
+
+    // cutoffs 20 Hz to 20 kHz, the plugin's Q range above 0.5, the response at f0 / 2, f0 and 2 f0.
+    // float coefficients are themselves up to a dB off at the lowest cutoffs, where a1
+    // is within a few ulp of -2, so at each rate the table is held to that plus table_tolerance
+    printf("\nlowpass from BiquadTable against the cookbook, worst response error in dB\n");
+    printf("%8s %12s %14s\n", "rate", "table", "float exact");
+    double table_worst = 0.;
+    for (double rate : {44100., 48000., 96000.})
+    {
+        BiquadTable table;
+        table.prepare((float)rate);
+        double table_error = 0., float_error = 0.;
+        for (double f0 = 20.; f0 < min(20000., 0.45 * rate); f0 *= 1.01)
+        {
+            for (double Q = 0.5; Q <= 4.; Q *= 1.05)
+            {
+                double exact[5];
+                float rounded[5], looked_up[5];
+                cookbook_lpf(f0, Q, rate, exact);
+                cookbook_lpf((float)f0, (float)Q, (float)rate, rounded);
+                table.lookup(BiquadTable::Lowpass, (float)f0, (float)Q, looked_up);
+                for (double f : {0.5 * f0, f0, 2. * f0})
+                {
+                    if (f > 0.49 * rate)
+                        continue;
+                    double reference = response_db(exact, f, rate);
+                    double t = abs(response_db(looked_up, f, rate) - reference);
+                    double r = abs(response_db(rounded, f, rate) - reference);
+                    table_error = max(table_error, t);
+                    float_error = max(float_error, r);
+                }
+            }
+        }
+        printf("%8.0f %12.3f %14.3f\n", rate, table_error, float_error);
+        table_worst = max(table_worst, table_error - float_error);
+    }
+    printf("worst table error over float exact %.3g dB (tolerance %.3g)\n", table_worst, table_tolerance);
+    failures += table_worst > table_tolerance;
+
+    // the same sweep through a BiquadFilter retuned every sample
+    BiquadTable table;
+    table.prepare(samplerate);
+    BiquadFilter<float> exact_biquad, table_biquad;
+    double exact_ns = time_blocks(in, scalar, 256, [&](const float *x, float *y, int n)
+                                  {
+                                      const float *w = &sweep[x - in.data()];
+                                      for (int i = 0; i < n; i++)
+                                      {
+                                          exact_biquad.lpf(w[i] * 0.45f * samplerate, q, samplerate);
+                                          y[i] = exact_biquad(x[i]);
+                                      }
+                                  });
+    double table_ns = time_blocks(in, block, 256, [&](const float *x, float *y, int n)
+                                  {
+                                      const float *w = &sweep[x - in.data()];
+                                      for (int i = 0; i < n; i++)
+                                      {
+                                          table_biquad.lpf(w[i] * 0.45f * samplerate, q, table);
+                                          y[i] = table_biquad(x[i]);
+                                      }
+                                  });
+    printf("biquad retuned every sample: cookbook %.2f, table %.2f\n", exact_ns, table_ns);
+    if (failures)
+        printf("%d deviations over tolerance\n", failures);
+    return failures ? 1 : 0;
+}
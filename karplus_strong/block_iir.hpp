@@ -0,0 +1,133 @@
+#pragma once
+#include <cmath>
+#include <cstring>
+#include "../common/simd.hpp"
+
+// block form of a two-state linear filter
+//   s[n+1] = A s[n] + B x[n]
+//   y[n]   = C s[n] + D x[n]
+// unrolled `Lanes` samples ahead: the group's outputs and the state after it
+// are one matrix times (inputs, state), done a column at a time in four-wide
+// registers. the rows are the Lanes outputs followed by the two new state
+// values, so the only chain from group to group is the state column.
+// the tables are rebuilt by configure(), call it when the coefficients change.
+template <int Lanes = 4>
+class BlockIIR
+{
+public:
+    static_assert(Lanes % 4 == 0, "whole registers only");
+    static constexpr int rows = Lanes / 4 + 1; // output registers, then one for the state
+
+    f4 from_input[Lanes][rows];
+    f4 from_state[2][rows];
+    // one sample at a time, for the tail of a block
+    float a[2][2], b[2], c[2], d;
+
+    void configure(const double (&A)[2][2], const double (&B)[2], const double (&C)[2], double D)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            b[i] = (float)B[i];
+            c[i] = (float)C[i];
+            for (int j = 0; j < 2; j++)
+                a[i][j] = (float)A[i][j];
+        }
+        d = (float)D;
+
+        // powers of A in double, so long groups do not drift
+        double P[2][2] = {{1, 0}, {0, 1}}; // A^k
+        double h[Lanes];                   // impulse response, h[0] = D, h[m] = C A^(m-1) B
+        double AB[Lanes][2];               // A^k B
+        double CA[Lanes][2];               // C A^k
+        h[0] = D;
+        for (int k = 0; k < Lanes; k++)
+        {
+            CA[k][0] = C[0] * P[0][0] + C[1] * P[1][0];
+            CA[k][1] = C[0] * P[0][1] + C[1] * P[1][1];
+            AB[k][0] = P[0][0] * B[0] + P[0][1] * B[1];
+            AB[k][1] = P[1][0] * B[0] + P[1][1] * B[1];
+            if (k + 1 < Lanes)
+                h[k + 1] = C[0] * AB[k][0] + C[1] * AB[k][1];
+            multiply(P, A);
+        }
+        // P is A^Lanes now
+
+        // column j: what input j adds to every row
+        alignas(16) float column[4 * rows];
+        for (int j = 0; j < Lanes; j++)
+        {
+            std::memset(column, 0, sizeof(column));
+            for (int k = j; k < Lanes; k++)
+                column[k] = (float)h[k - j];
+            column[Lanes] = (float)AB[Lanes - 1 - j][0];
+            column[Lanes + 1] = (float)AB[Lanes - 1 - j][1];
+            for (int r = 0; r < rows; r++)
+                from_input[j][r] = f4::load(column + 4 * r);
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            std::memset(column, 0, sizeof(column));
+            for (int k = 0; k < Lanes; k++)
+                column[k] = (float)CA[k][i];
+            column[Lanes] = (float)P[0][i];
+            column[Lanes + 1] = (float)P[1][i];
+            for (int r = 0; r < rows; r++)
+                from_state[i][r] = f4::load(column + 4 * r);
+        }
+    }
+
+    // out may alias in; s is the state, read and written back
+    void process(const float *in, float *out, int n, float (&s)[2]) const
+    {
+        alignas(16) float result[4 * rows];
+        float s0 = s[0], s1 = s[1];
+        int i = 0;
+        for (; i + Lanes <= n; i += Lanes)
+        {
+            // the input columns do not wait on the state
+            f4 acc[rows];
+            for (int r = 0; r < rows; r++)
+                acc[r] = f4::set(0.f);
+            for (int j = 0; j < Lanes; j++)
+            {
+                const f4 x = f4::set(in[i + j]);
+                for (int r = 0; r < rows; r++)
+                    acc[r] = acc[r] + from_input[j][r] * x;
+            }
+
+            const f4 state0 = f4::set(s0), state1 = f4::set(s1);
+            for (int r = 0; r < rows; r++)
+            {
+                acc[r] = acc[r] + from_state[0][r] * state0 + from_state[1][r] * state1;
+                acc[r].store(result + 4 * r);
+            }
+            std::memcpy(out + i, result, Lanes * sizeof(float));
+            s0 = result[Lanes];
+            s1 = result[Lanes + 1];
+        }
+        for (; i < n; i++)
+        {
+            float x = in[i];
+            float y = c[0] * s0 + c[1] * s1 + d * x;
+            float n0 = a[0][0] * s0 + a[0][1] * s1 + b[0] * x;
+            float n1 = a[1][0] * s0 + a[1][1] * s1 + b[1] * x;
+            s0 = n0;
+            s1 = n1;
+            out[i] = y;
+        }
+        s[0] = s0;
+        s[1] = s1;
+    }
+
+private:
+    static void multiply(double (&P)[2][2], const double (&A)[2][2])
+    {
+        double R[2][2];
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                R[i][j] = A[i][0] * P[0][j] + A[i][1] * P[1][j];
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                P[i][j] = R[i][j];
+    }
+};
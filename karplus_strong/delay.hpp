@@ -1,5 +1,7 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <vector>
+#include "delay_line.hpp"
+#include "../common/realtime_guard.hpp"
 
 template <typename T>
 T mtof(T m)
@@ -13,43 +15,6 @@ T dbtoa(T db)
     return pow(T(10), db / T(20));
 }
 
-class DelayLine : std::vector<float>
-{
-    //
-    int index = 0;
-
-public:
-    float read(float seconds_ago, float samplerate)
-    {
-        //
-        jassert(seconds_ago < size() / samplerate);
-
-        float i = index - seconds_ago * samplerate;
-        if (i < 0)
-        {
-            i += size();
-        }
-        return at((int)i); // no linear interpolation
-    }
-
-    void write(float value)
-    {
-        jassert(size() > 0);
-        at(index) = value; // overwrite the oldest value
-
-        // handle the wrapping for circular buffer
-        index++;
-        if (index >= size())
-            index = 0;
-    }
-
-    void allocate(float seconds, float samplerate)
-    {
-        // floor(seconds * samplerate) + 1 samples
-        resize((int)floor(seconds * samplerate) + 1);
-    }
-};
-
 class Delay : public juce::AudioProcessor
 {
     juce::AudioParameterFloat *gain;
@@ -58,7 +23,11 @@ class Delay : public juce::AudioProcessor
 
     /// add parameters here ///////////////////////////////////////////////////
 
-    DelayLine delay_line;
+    // one line per precision, prepareToPlay only sizes the one the host runs
+    DelayLine<float> delay_line;
+    DelayLine<double> delay_line_double;
+    DelayLine<float> &line(float) { return delay_line; }
+    DelayLine<double> &line(double) { return delay_line_double; }
 
 public:
     Delay()
@@ -89,31 +58,45 @@ public:
     void processBlock(juce::AudioBuffer<float> &buffer,
                       juce::MidiBuffer &) override
     {
+        process(buffer);
+    }
+
+    /// handle doubles ////////////////////////////////////////////////////////
+    void processBlock(juce::AudioBuffer<double> &buffer,
+                      juce::MidiBuffer &) override
+    {
+        process(buffer);
+    }
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+
+    template <typename Sample>
+    void process(juce::AudioBuffer<Sample> &buffer)
+    {
+        RealtimeScope realtime;
         buffer.clear(0, 0, buffer.getNumSamples());
         auto left = buffer.getWritePointer(0, 0);
         auto right = buffer.getWritePointer(1, 0);
+        auto &delay = line(Sample());
 
         //   printf("got here\n"); // i/o ~ might take a while
 
         for (int i = 0; i < buffer.getNumSamples(); ++i)
         {
-            delay_line.write((left[i] + right[i]) / 2);
-            left[i] = delay_line.read(delay_time->get(), (float)getSampleRate());
+            delay.write((left[i] + right[i]) / 2);
+            left[i] = delay.read((Sample)delay_time->get(), (Sample)getSampleRate());
             right[i] = left[i];
         }
     }
 
-    /// handle doubles ? //////////////////////////////////////////////////////
-    // void processBlock(AudioBuffer<double>& buffer, MidiBuffer&) override {
-    //   buffer.applyGain(dbtoa((float)*gain));
-    // }
-
     /// start and shutdown callbacks///////////////////////////////////////////
     void prepareToPlay(double samplerate, int) override
     {
         // XXX when does this get called? seems to not get called in stand-alone
-        delay_line.allocate(delay_time->getNormalisableRange().end,
-                            (float)samplerate);
+        if (isUsingDoublePrecision())
+            delay_line_double.allocate(delay_time->getNormalisableRange().end, samplerate);
+        else
+            delay_line.allocate(delay_time->getNormalisableRange().end,
+                                (float)samplerate);
     }
     void releaseResources() override {}
 
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// interpolation policies for DelayLine. each one reads `delay` samples back
+// from `now` (where the next write goes) in a power-of-two ring:
+//   min_delay  the shortest delay it can read without touching unwritten samples
+//   extra      how many samples older than floor(delay) it reads
+// the allpass keeps a filter state, so it wants one read per sample from a
+// single reader and a delay that moves slowly, like a tuned string.
+
+template <typename T>
+struct LinearInterpolation
+{
+    static constexpr float min_delay = 1;
+    static constexpr int extra = 1;
+
+    void reset() {}
+
+    T read(const T *data, size_t mask, size_t now, T delay)
+    {
+        size_t i = (size_t)delay;
+        T f = delay - (T)i;
+        T a = data[(now - i) & mask];
+        T b = data[(now - i - 1) & mask];
+        return a + f * (b - a);
+    }
+};
+
+// first order allpass (Jaffe and Smith): flat magnitude, so a string loses no
+// extra energy to the fraction; the fraction is kept in [0.5, 1.5) where the
+// phase delay is closest to what it is asked for
+template <typename T>
+struct AllpassInterpolation
+{
+    static constexpr float min_delay = 1.5f;
+    static constexpr int extra = 1;
+
+    T y1 = 0;
+    T last_delay = -1, eta = 0;
+    size_t whole = 0;
+
+    void reset() { y1 = 0; }
+
+    // the coefficient for `delay`, and in `whole` the samples back that x0 is read from
+    static T coefficient(T delay, size_t &whole)
+    {
+        whole = (size_t)(delay - T(0.5));
+        T f = delay - (T)whole;
+        return (1 - f) / (1 + f);
+    }
+
+    // one output from x0 = the sample `whole` back, x1 the one before it and
+    // the previous output; V is T or a vector of T, like the f4 lanes of StringBank
+    template <typename V>
+    static V step(V eta, V x0, V x1, V y1)
+    {
+        // only the last multiply waits on the previous output
+        return eta * x0 + x1 - eta * y1;
+    }
+
+    T read(const T *data, size_t mask, size_t now, T delay)
+    {
+        if (delay != last_delay)
+        {
+            eta = coefficient(delay, whole);
+            last_delay = delay;
+        }
+        y1 = step(eta, data[(now - whole) & mask], data[(now - whole - 1) & mask], y1);
+        return y1;
+    }
+};
+
+// circular buffer with a power-of-two size, so the wrap is a mask. read(d)
+// returns what was written d writes ago, between samples as the policy says;
+// d is clamped to what the line holds, no shorter than min_delay.
+template <typename T, template <typename> class Policy = LinearInterpolation>
+class DelayLine
+{
+    std::vector<T> data;
+    size_t mask = 0;
+    size_t now = 0; // where the next write goes, counts up forever and is masked on use
+    T longest = 0;
+    using Interpolation = Policy<T>;
+    Interpolation interpolation;
+
+public:
+    // room for delays of at least `samples`. a new size starts silent and
+    // allocates, so not on the audio thread; the same size keeps the contents
+    void resize(int samples)
+    {
+        size_t size = 1;
+        while (size < (size_t)std::max(samples, 1) + Interpolation::extra + 1)
+            size <<= 1;
+        if (size != data.size())
+        {
+            data.assign(size, T(0));
+            now = 0;
+            interpolation.reset();
+        }
+        mask = size - 1;
+        longest = T(size - 1 - Interpolation::extra);
+    }
+
+    void allocate(T seconds, T samplerate)
+    {
+        resize((int)std::ceil(seconds * samplerate));
+    }
+
+    void write(T value)
+    {
+        assert(!data.empty());
+        data[now & mask] = value; // overwrite the oldest value
+        now++;
+    }
+
+    T read(T delay)
+    {
+        assert(!data.empty());
+        delay = std::min(std::max(delay, T(Interpolation::min_delay)), longest);
+        return interpolation.read(data.data(), mask, now, delay);
+    }
+
+    T read(T seconds_ago, T samplerate)
+    {
+        return read(seconds_ago * samplerate);
+    }
+};
@@ -0,0 +1,476 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "block_iir.hpp"
+
+// Audio EQ Cookbook lpf/hpf/bpf coefficients from a table, so a filter can be
+// retuned every sample for two index computations and four table reads.
+// the three responses share their poles, so the table only holds (a1, a2) on a
+// grid of normalized cutoff (f0 / samplerate) and Q; the zeros follow from them
+//   lpf: b0 = b2 = (1 + a1 + a2) / 4, b1 = 2 b0
+//   hpf: b0 = b2 = (1 - a1 + a2) / 4, b1 = -2 b0
+//   bpf: b0 = -b2 = (1 - a2) / 2, b1 = 0
+// both axes are spaced by a "pseudo log2": the exponent of the float plus its
+// mantissa read as a fraction, which is just the float's bits scaled. the poles
+// are interpolated bilinearly; the stable region of (a1, a2) is a triangle,
+// so blends of stable neighbours stay stable.
+class BiquadTable
+{
+public:
+    enum Response
+    {
+        Lowpass,
+        Highpass,
+        Bandpass
+    };
+
+    // cutoff from 2^-14 (about 3 Hz at 48 kHz) up to just below nyquist, Q from 1/16 to 32
+    static constexpr int octave_steps = 24, min_octave = -14, max_octave = -1;
+    static constexpr int q_steps = 8, min_q_octave = -4, max_q_octave = 5;
+    static constexpr int num_cutoffs = (max_octave - min_octave) * octave_steps + 1;
+    static constexpr int num_qs = (max_q_octave - min_q_octave) * q_steps + 1;
+
+    // the table itself does not depend on the rate, so only the first call builds it
+    void prepare(float samplerate)
+    {
+        inverse_samplerate = 1.f / samplerate;
+        if (!poles.empty())
+            return;
+
+        poles.resize((size_t)num_cutoffs * num_qs * 2);
+        for (int i = 0; i < num_cutoffs; i++)
+            for (int j = 0; j < num_qs; j++)
+            {
+                double f = pseudo_exp2(min_octave + (double)i / octave_steps);
+                double Q = pseudo_exp2(min_q_octave + (double)j / q_steps);
+                double w0 = 2 * M_PI * std::min(f, 0.499);
+                double alpha = std::sin(w0) / (2 * Q);
+                poles[index(i, j)] = (float)(-2 * std::cos(w0) / (1 + alpha));
+                poles[index(i, j) + 1] = (float)((1 - alpha) / (1 + alpha));
+            }
+    }
+
+    // c = {b0, b1, b2, a1, a2}, normalized
+    void lookup(Response response, float f0, float Q, float (&c)[5]) const
+    {
+        float x = (pseudo_log2(f0 * inverse_samplerate) - min_octave) * octave_steps;
+        float y = (pseudo_log2(Q) - min_q_octave) * q_steps;
+        x = std::min(std::max(x, 0.f), num_cutoffs - 1.001f);
+        y = std::min(std::max(y, 0.f), num_qs - 1.001f);
+        int i = (int)x, j = (int)y;
+        float u = x - i, v = y - j;
+
+        const float *p00 = &poles[index(i, j)];
+        const float *p10 = &poles[index(i + 1, j)];
+        float low1 = p00[0] + v * (p00[2] - p00[0]), high1 = p10[0] + v * (p10[2] - p10[0]);
+        float low2 = p00[1] + v * (p00[3] - p00[1]), high2 = p10[1] + v * (p10[3] - p10[1]);
+        float a1 = low1 + u * (high1 - low1);
+        float a2 = low2 + u * (high2 - low2);
+
+        switch (response)
+        {
+        case Lowpass:
+            c[0] = c[2] = (1 + a1 + a2) * 0.25f;
+            c[1] = 2 * c[0];
+            break;
+        case Highpass:
+            c[0] = c[2] = (1 - a1 + a2) * 0.25f;
+            c[1] = -2 * c[0];
+            break;
+        default:
+            c[0] = (1 - a2) * 0.5f;
+            c[1] = 0;
+            c[2] = -c[0];
+            break;
+        }
+        c[3] = a1;
+        c[4] = a2;
+    }
+
+private:
+    std::vector<float> poles; // [cutoff][q][a1, a2]
+    float inverse_samplerate = 1.f / 44100.f;
+
+    static size_t index(int i, int j)
+    {
+        return ((size_t)i * num_qs + j) * 2;
+    }
+
+    // exponent + mantissa fraction, exact at powers of two and monotonic in between
+    static float pseudo_log2(float x)
+    {
+        int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return bits * (1.f / (1 << 23)) - 127.f;
+    }
+
+    static double pseudo_exp2(double p)
+    {
+        double e = std::floor(p);
+        return std::ldexp(1 + (p - e), (int)e);
+    }
+};
+
+template <typename T>
+class BiquadFilter
+{
+    // Audio EQ Cookbook
+    // http://www.musicdsp.org/files/Audio-EQ-Cookbook.txt
+
+    // x[n-1], x[n-2], y[n-1], y[n-2]
+    T x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+
+    // filter coefficients
+    T b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+
+    // the same filter for process(), rebuilt when the coefficients change
+    BlockIIR<> block;
+    bool block_ready = false;
+
+public:
+    T operator()(T x0)
+    {
+        // Direct Form 1, normalized...
+        T y0 = b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        y2 = y1;
+        y1 = y0;
+        x2 = x1;
+        x1 = x0;
+        return y0;
+    }
+
+    // n samples at once, same as calling operator() on each up to rounding; out may be in
+    void process(const T *in, T *out, int n)
+    {
+        if (n <= 0)
+            return;
+        if constexpr (!std::is_same<T, float>::value)
+        {
+            // the block form is four floats wide, doubles go a sample at a time
+            for (int i = 0; i < n; i++)
+                out[i] = (*this)(in[i]);
+        }
+        else
+        {
+            if (!block_ready)
+            {
+                // transposed direct form II as a state space system
+                const double A[2][2] = {{-a1, 1}, {-a2, 0}};
+                const double B[2] = {b1 - (double)a1 * b0, b2 - (double)a2 * b0};
+                const double C[2] = {1, 0};
+                block.configure(A, B, C, b0);
+                block_ready = true;
+            }
+
+            // the direct form I history holds the same information
+            float s[2] = {b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2, b2 * x1 - a2 * y1};
+            float last = in[n - 1], before = n > 1 ? in[n - 2] : x1;
+            block.process(in, out, n, s);
+
+            x2 = before;
+            x1 = last;
+            y2 = n > 1 ? out[n - 2] : y1;
+            y1 = out[n - 1];
+        }
+    }
+
+    void normalize(T a0)
+    {
+        b0 /= a0;
+        b1 /= a0;
+        b2 /= a0;
+        a1 /= a0;
+        a2 /= a0;
+        block_ready = false;
+    }
+
+    void lpf(T f0, T Q, T samplerate)
+    {
+        T w0 = 2 * T(M_PI) * f0 / samplerate;
+        T alpha = sin(w0) / (2 * Q);
+        b0 = (1 - cos(w0)) / 2;
+        b1 = 1 - cos(w0);
+        b2 = (1 - cos(w0)) / 2;
+        T a0 = 1 + alpha;
+        a1 = -2 * cos(w0);
+        a2 = 1 - alpha;
+
+        normalize(a0);
+    }
+
+    void hpf(T f0, T Q, T samplerate)
+    {
+        T w0 = 2 * T(M_PI) * f0 / samplerate;
+        T alpha = sin(w0) / (2 * Q);
+        b0 = (1 + cos(w0)) / 2;
+        b1 = -(1 + cos(w0));
+        b2 = (1 + cos(w0)) / 2;
+        T a0 = 1 + alpha;
+        a1 = -2 * cos(w0);
+        a2 = 1 - alpha;
+
+        normalize(a0);
+    }
+
+    // constant 0 dB peak gain
+    void bpf(T f0, T Q, T samplerate)
+    {
+        T w0 = 2 * T(M_PI) * f0 / samplerate;
+        T alpha = sin(w0) / (2 * Q);
+        b0 = alpha;
+        b1 = 0;
+        b2 = -alpha;
+        T a0 = 1 + alpha;
+        a1 = -2 * cos(w0);
+        a2 = 1 - alpha;
+
+        normalize(a0);
+    }
+
+    // the same responses from a prepared table, cheap enough to call every sample
+    void lpf(T f0, T Q, const BiquadTable &table) { set(table, BiquadTable::Lowpass, f0, Q); }
+    void hpf(T f0, T Q, const BiquadTable &table) { set(table, BiquadTable::Highpass, f0, Q); }
+    void bpf(T f0, T Q, const BiquadTable &table) { set(table, BiquadTable::Bandpass, f0, Q); }
+
+private:
+    void set(const BiquadTable &table, BiquadTable::Response response, T f0, T Q)
+    {
+        float c[5];
+        table.lookup(response, f0, Q, c);
+        b0 = c[0];
+        b1 = c[1];
+        b2 = c[2];
+        a1 = c[3];
+        a2 = c[4];
+        block_ready = false;
+    }
+};
+
+template <typename T>
+class History
+{
+    T _data = 0;
+
+public:
+    T operator()(T in)
+    {
+        T value = _data;
+        _data = in;
+        return value;
+    }
+    T operator()() { return _data; }
+};
+
+// adapted from this JOS3 paper:
+// https://ccrma.stanford.edu/~jos/svf/svf.pdf
+//
+template <typename T>
+class StateVariableFilter
+{
+    // TODO:
+    // * parameterize q and wct
+    // * compress expressions
+    // * rename variables
+    History<T> z1;
+    History<T> z2;
+
+    T _high = 0;
+    T _mid = 0;
+    T _low = 0;
+
+    // the same filter for process(), for the wct and q it was built with
+    BlockIIR<> block;
+    T block_wct = -1, block_q = -1;
+
+public:
+    void step(T in, T wct, T q)
+    {
+        _mid = z2();
+        T mul_3 = z2() * -q;
+        T mul_4 = z2() * wct;
+        T add_5 = mul_4 + z1();
+        _low = add_5;
+        T mul_6 = add_5 * -1;
+        T add_7 = mul_3 + mul_6;
+        T add_8 = in + add_7;
+        _high = add_8;
+        T mul_9 = add_8 * wct;
+        T add_10 = mul_9 + z2();
+        // https://stackoverflow.com/questions/2487653/avoiding-denormal-values-in-c
+        // float history_1_next_11 = fixdenorm(add_5);
+        // float history_2_next_12 = fixdenorm(add_10);
+        // float z1 = history_1_next_11;
+        // float z2 = history_2_next_12;
+        z1(add_5);
+        z2(add_10);
+        // for a clearer implementation, go here:
+        // https://github.com/JordanTHarris/VAStateVariableFilter/blob/master/Source/Effects/VAStateVariableFilter.cpp
+        // of maybe look at this:
+        // https://github.com/JamesWenlock/StateVariableFilter/blob/master/Source/PluginProcessor.cpp
+    }
+
+    // writes low() for n samples, same as calling step() on each up to rounding; out may be in
+    void process(const T *in, T *out, int n, T wct, T q)
+    {
+        if (n <= 0)
+            return;
+        if constexpr (!std::is_same<T, float>::value)
+        {
+            // the block form is four floats wide, doubles go a sample at a time
+            for (int i = 0; i < n; i++)
+            {
+                step(in[i], wct, q);
+                out[i] = _low;
+            }
+        }
+        else
+        {
+            if (wct != block_wct || q != block_q)
+            {
+                // step() with the state (z1, z2) written out
+                const double A[2][2] = {{1, wct}, {-wct, 1 - (double)wct * (q + wct)}};
+                const double B[2] = {0, wct};
+                const double C[2] = {1, wct};
+                block.configure(A, B, C, 0);
+                block_wct = wct;
+                block_q = q;
+            }
+
+            float s[2] = {z1(), z2()};
+            block.process(in, out, n - 1, s);
+            z1(s[0]);
+            z2(s[1]);
+            // the last one by hand, so high(), mid() and low() stay valid
+            step(in[n - 1], wct, q);
+            out[n - 1] = _low;
+        }
+    }
+
+    T high() { return _high; }
+    T mid() { return _mid; }
+    T low() { return _low; }
+
+    // addapted from this Max/Gen implementation of the JOS3 paper
+    /*
+  <pre><code>
+  ----------begin_max5_patcher----------
+  646.3ocyW1saaCBFF9X6qBKNbKMxefM1d2JSUStInVpRvV1jtTU068Y9wSoU
+  taPMTkSZEDBu7v2O7lWRSP20clMhx9Q1OyRRdIMIQOkZhD63Dzw1y6NzNpWF
+  Rv9c2cOh1X9HI6rTOMWjQlmTb5X2I4AlT+M.6rlojO2yLxgPY2Z+H9d8dLsu
+  2.UWrKbw7ljamruUt6At39eMv1IM6SMTuMeSFPHp+g0Cv3s4Y2p9Jullp9yl
+  0Q22BBZzEQC+wnUlCJZJMDha1VdshVounUPKUzPxqhGZSm8L7x3ku.CEKx.7
+  OBOkkpCukAR40alGw2vCEnWfV7BOD2COXeCOzFcYiJSKdgmraffDg.uoyDgJ
+  v5VD3pXP22CBZ4d21qH+h.WSQLR9BBZMd20yjENSFDCxdfOJ6FdND7U8I6Hh
+  wFLKtZSJq8+o3pKHKNMDCXji5c6DpNXQpfq7HW4m8oLCYwIxM49MLOC3q4Wa
+  CkY3hh42I3vg.NruvUUnoBr0bQANkIDvYSHdaQzFerN3+.OH5KKzAt38+RL8
+  Fpl+sbM1cZX27UsslHK+uW46YiRtnUx6DWrF5aVS2vd1f9ru3UoqBScPX0gC
+  9fPlq5T4fNP4xDRVkx0Nnr8zEcBqM2juGPb7uZKhQxiSJSVV47UoL3b9zZSb
+  AWJMUNjWcBDPcLCZsB03BQzXD1vtpLD5TUWXNJ0HXWqQffWi3fxMgHuk33aH
+  qUHmpDwQocC3ZS.3qfQXYFW2yHy8v9u4KvBVeZ66ehMLZWrViIyaO1oOW0az
+  C4ByvR8vA1S740q89iZGl7dImLdcZPetPmoF2ZnicSDJNwsUiSzMIo1Xnn8H
+  aru0.BZ+X+16YBT5qo+A9hsJf.
+  -----------end_max5_patcher-----------
+  </code></pre>
+    */
+};
+
+// topology-preserving (zero delay feedback) version of the same filter, after
+// Zavalishin's "The Art of VA Filter Design" and Simper's SvfLinearTrapOptimised2.
+// the cutoff is prewarped through tan(), so it lands where it is asked to and
+// the filter stays stable for any cutoff below nyquist, changed every sample.
+// q is the damping (1 / Q) like in StateVariableFilter::step
+template <typename T>
+class TptStateVariableFilter
+{
+    T ic1eq = 0, ic2eq = 0; // trapezoidal integrator states
+    T pi_over_samplerate = T(M_PI) / 44100;
+
+    // coefficients for the last cutoff and q, so a steady cutoff skips the tan and the divide
+    T a1 = 1, a2 = 0, a3 = 0;
+    T tuned_cutoff = -1, tuned_q = -1;
+
+    T _high = 0;
+    T _mid = 0;
+    T _low = 0;
+
+public:
+    // tan on [0, pi/2) as a Pade [5/4] fraction num / den: within 3e-4 relative
+    // up to 0.49 of the sample rate, and like tan it runs off to infinity at
+    // pi/2 instead of wrapping round
+    static void fast_tan(T x, T &num, T &den)
+    {
+        T xx = x * x;
+        num = x * (T(945) - xx * (T(105) - xx));
+        den = T(945) - xx * (T(420) - T(15) * xx);
+    }
+
+    static T fast_tan(T x)
+    {
+        T num, den;
+        fast_tan(x, num, den);
+        return num / den;
+    }
+
+    void prepare(T samplerate)
+    {
+        pi_over_samplerate = T(M_PI) / samplerate;
+        tuned_cutoff = -1;
+    }
+
+    // cutoff and q may change every sample, the coefficients are only redone when they do
+    void step(T in, T cutoff, T q)
+    {
+        if (cutoff != tuned_cutoff || q != tuned_q)
+            tune(cutoff, q);
+        tick(in, q);
+    }
+
+    // writes low() for n samples at one cutoff and q, same as calling step() on each; out may be in
+    void process(const T *in, T *out, int n, T cutoff, T q)
+    {
+        if (cutoff != tuned_cutoff || q != tuned_q)
+            tune(cutoff, q);
+        for (int i = 0; i < n; i++)
+        {
+            tick(in[i], q);
+            out[i] = _low;
+        }
+    }
+
+    T high() { return _high; }
+    T mid() { return _mid; }
+    T low() { return _low; }
+
+private:
+    void tune(T cutoff, T q)
+    {
+        // keep clear of nyquist, where g blows up
+        T x = std::min(std::max(cutoff * pi_over_samplerate, T(0)), T(0.49 * M_PI));
+        // g = n / d, folded into the coefficients so there is one divide
+        T n, d;
+        fast_tan(x, n, d);
+        T r = 1 / (d * d + n * (n + q * d));
+        a1 = d * d * r; // 1 / (1 + g (g + q))
+        a2 = n * d * r; // g a1
+        a3 = n * n * r; // g a2
+        tuned_cutoff = cutoff;
+        tuned_q = q;
+    }
+
+    void tick(T in, T q)
+    {
+        T v3 = in - ic2eq;
+        T v1 = a1 * ic1eq + a2 * v3;
+        T v2 = ic2eq + a2 * ic1eq + a3 * v3;
+        ic1eq = 2 * v1 - ic1eq;
+        ic2eq = 2 * v2 - ic2eq;
+
+        _low = v2;
+        _mid = v1;
+        _high = in - q * v1 - v2;
+    }
+};
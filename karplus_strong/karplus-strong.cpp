@@ -5,58 +5,27 @@
 //
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <type_traits>
+#include <vector>
+#include "delay_line.hpp"
 #include "utility.hpp"
-
-class DelayLine : std::vector<float>
-{
-    //
-    int index = 0;
-
-public:
-    float read(float seconds_ago, float samplerate)
-    {
-        //
-        jassert(seconds_ago < size() / samplerate);
-
-        float i = index - seconds_ago * samplerate;
-        if (i < 0)
-        {
-            i += size();
-        }
-        return at((int)i); // no linear interpolation
-    }
-
-    void write(float value)
-    {
-        jassert(size() > 0);
-        at(index) = value; // overwrite the oldest value
-
-        // handle the wrapping for circular buffer
-        index++;
-        if (index >= size())
-            index = 0;
-    }
-
-    void allocate(float seconds, float samplerate)
-    {
-        // floor(seconds * samplerate) + 1 samples
-        resize((int)floor(seconds * samplerate) + 1);
-    }
-};
+#include "../common/simd.hpp"
+#include "../common/realtime_guard.hpp"
 
 // https://en.wikipedia.org/wiki/Harmonic_oscillator
+template <typename T>
 struct MassSpringModel
 {
     // this the whole state of the simulation
     //
-    float position{0}; // m
-    float velocity{0}; // m/s
+    T position{0}; // m
+    T velocity{0}; // m/s
 
     // These are cached properties of the model; They govern the behaviour. We
     // recalculate them given frequency, decay time, and playback rate.
     //
-    float springConstant{0};     // N/m
-    float dampingCoefficient{0}; // N·s/m
+    T springConstant{0};     // N/m
+    T dampingCoefficient{0}; // N·s/m
 
     void show()
     {
@@ -70,7 +39,7 @@ struct MassSpringModel
         position = velocity = 0;
     }
 
-    float next_sample()
+    T next_sample()
     {
         // This is semi-implicit Euler integration with time-step 1. The
         // playback rate is "baked into" the constants. Spring force and damping
@@ -78,7 +47,7 @@ struct MassSpringModel
         // disappears. Velocity is accumulated into position which is
         // interpreted as oscillator amplitude.
         //
-        float acceleration = 0;
+        T acceleration = 0;
 
         acceleration = -position * springConstant - dampingCoefficient * velocity;
 
@@ -95,16 +64,16 @@ struct MassSpringModel
         return position;
     }
 
-    float operator()()
+    T operator()()
     {
         return next_sample();
     }
 
     // Use these to measure the kinetic, potential, and total energy of the
     // system.
-    float ke() { return velocity * velocity / 2; }
-    float pe() { return position * position * springConstant / 2; }
-    float te() { return ke() + pe(); }
+    T ke() { return velocity * velocity / 2; }
+    T pe() { return position * position * springConstant / 2; }
+    T te() { return ke() + pe(); }
 
     // "Kick" the mass-spring system such that we get a nice (-1, 1) oscillation.
     //
@@ -125,7 +94,7 @@ struct MassSpringModel
         // depending on frequency according to the Fletcher-Munson curves.
     }
 
-    void recalculate(float frequency, float decayTime, float playbackRate)
+    void recalculate(T frequency, T decayTime, T playbackRate)
     {
 
         // frequency equals to 2pi/(sqrt(1-ksi^2)*w0)
@@ -167,56 +136,400 @@ struct BooleanOscillator
     }
 };
 
-struct KarplusStrongModel
+// Karplus-Strong strings four at a time: an allpass tuned read, a two point
+// mean and the loop gain, with every string in a lane. the allpass is
+// AllpassInterpolation's coefficient and step, run per lane. the lines of a
+// group are interleaved, frame k holds sample k of all four, and every group
+// shares one write position, so the write is a single store and only the
+// reads, each lane at its own delay, gather. float runs in f4 registers a
+// chunk at a time, and a chunk that stays clear of the end of the line reads
+// each lane through its own pointer; double runs lane by lane.
+// a group with no string on is skipped; a string that is off has no gain, so
+// it adds nothing even while its group runs.
+template <typename T>
+class StringBank
 {
-    float gain = 1;
-    float t60 = 1;
-    float delayTime = 1;
-    int sampleRate = 48000;
-
-    DelayLine delay;
-    MeanFilter filter;
+public:
+    static constexpr int lanes = 4;
+    static constexpr int chunk = 64; // samples per pass over the groups
 
-    void configure(float hertz, float seconds, float samplerate)
+    // not the audio thread; rounds up to whole groups, every line long enough
+    // for one period of the lowest note
+    void prepare(int strings, T samplerate, T lowest_hertz)
     {
-        delayTime = 1 / hertz;
-        t60 = seconds;
-        int k = t60 / delayTime;
-        gain = pow(dbtoa(-60.0), 1.0f / k);
+        groups = std::max(1, (strings + lanes - 1) / lanes);
         sampleRate = samplerate;
-        delay.allocate(seconds, samplerate);
-        // given t60 (`seconds`) and frequency (`Hertz`), calculate
-        // the gain...
-        //
-        // for a given frequency, our algorithm applies *gain*
-        // frequency-many times per second. given a t60 time we can
-        // calculate how many times (n)  gain will be applied in
-        // those t60 seconds. we want to reduce the signal by 60dB
-        // over t60 seconds or over n-many applications. this means
-        // that we want gain to be a number that, when multiplied
-        // by itself n times, becomes 60 dB quieter than it began.
-        //
-        // the size of the delay *is* the period of the vibration
-        // of the string, so 1/period = frequency.
+        size_t size = 1;
+        while (size < (size_t)std::ceil(samplerate / lowest_hertz) + 2)
+            size <<= 1;
+        mask = size - 1;
+        frames.assign(groups * size, Frame());
+        state.assign(groups, Group());
+        now = 0;
+    }
+
+    int size() const { return groups * lanes; }
+
+    void configure(int string, T hertz, T seconds)
+    {
+        Group &g = state[string / lanes];
+        int l = string % lanes;
+        // the mean filter delays half a sample, the allpass makes up the fraction;
+        // notes below the prepared lowest one play sharp
+        T delay = std::min(std::max(sampleRate / hertz - T(0.5), T(Allpass::min_delay)), T(mask - 1));
+        g.eta[l] = Allpass::coefficient(delay, g.offset[l]);
+        g.period[l] = 1 / hertz;
+        g.t60[l] = seconds;
+        g.decay[l] = loop_gain(seconds, 1 / hertz);
+    }
+
+    // fills the period behind the write position with noise, the excitation
+    // only this lane reads; the string sounds from the next sample
+    void trigger(int string, T amplitude)
+    {
+        Group &g = state[string / lanes];
+        int l = string % lanes;
+        Frame *line = frames.data() + (string / lanes) * (mask + 1);
+        size_t n = std::min((size_t)std::ceil(g.period[l] * sampleRate), mask);
+        for (size_t k = 1; k <= n; ++k)
+            line[(now - k) & mask].lane[l] = amplitude * g.decay[l] * rng.uniform();
+        g.y1[l] = g.x1[l] = 0;
+        g.gain[l] = g.decay[l];
+        g.peak[l] = amplitude; // loud until the next cull, however late in the block
+        g.on |= 1 << l;
+    }
+
+    // shorten the decay of a sounding string; never lengthens it
+    void damp(int string, T seconds)
+    {
+        Group &g = state[string / lanes];
+        int l = string % lanes;
+        if (seconds >= g.t60[l])
+            return;
+        g.t60[l] = seconds;
+        g.decay[l] = loop_gain(seconds, g.period[l]);
+        if (g.on & (1 << l))
+            g.gain[l] = g.decay[l];
     }
 
-    float trigger()
+    // silent from the next sample
+    void stop(int string)
     {
-        // fill the delay line with noise
-        int n = int(ceil(delayTime * sampleRate));
-        for (int i = 0; i < n; ++i)
+        Group &g = state[string / lanes];
+        int l = string % lanes;
+        g.gain[l] = 0;
+        g.on &= ~(1 << l);
+    }
+
+    // the loudest sample since the last call
+    T take_peak(int string)
+    {
+        Group &g = state[string / lanes];
+        int l = string % lanes;
+        T peak = g.peak[l];
+        g.peak[l] = 0;
+        return peak;
+    }
+
+    // the sum of every string into out[0, n)
+    void render(T *out, int n)
+    {
+        if constexpr (std::is_same<T, float>::value)
+        {
+            // lanes add up in registers, across lanes only once per sample at the end
+            for (int start = 0; start < n; start += chunk)
+            {
+                int m = std::min(chunk, n - start);
+                f4 mix[chunk];
+                for (int k = 0; k < m; ++k)
+                    mix[k] = f4::set(0.f);
+                for (int g = 0; g < groups; ++g)
+                    if (state[g].on != 0)
+                        run_f4(state[g], frames.data() + g * (mask + 1), mix, m);
+                alignas(16) float v[lanes];
+                for (int k = 0; k < m; ++k)
+                {
+                    mix[k].store(v);
+                    out[start + k] = (v[0] + v[1]) + (v[2] + v[3]);
+                }
+                now += m;
+            }
+        }
+        else
         {
-            delay.write(gain * (double)std::rand() / (RAND_MAX));
+            std::fill(out, out + n, T(0));
+            for (int g = 0; g < groups; ++g)
+                if (state[g].on != 0)
+                    run(state[g], frames.data() + g * (mask + 1), out, n);
+            now += n;
         }
     }
 
-    float operator()()
+private:
+    struct alignas(16) Frame
+    {
+        T lane[lanes] = {};
+    };
+
+    // per lane state, one array per field so a field loads as a register
+    struct Group
+    {
+        alignas(16) T gain[lanes] = {};  // in the loop, 0 while the string is off
+        alignas(16) T eta[lanes] = {};   // allpass coefficient
+        alignas(16) T y1[lanes] = {};    // allpass output
+        alignas(16) T x1[lanes] = {};    // mean filter input
+        alignas(16) T peak[lanes] = {};
+        T decay[lanes] = {};             // the gain for t60, kept while off
+        T t60[lanes] = {};
+        T period[lanes] = {};            // seconds
+        size_t offset[lanes] = {};       // whole samples of the read delay
+        int on = 0;                      // a bit per lane
+    };
+
+    std::vector<Frame> frames; // groups lines of mask + 1 frames
+    std::vector<Group> state;
+    int groups = 0;
+    size_t mask = 0;
+    size_t now = 0; // where the next write goes, counts up forever and is masked on use
+    T sampleRate = 48000;
+    Xoshiro rng;
+    using Allpass = AllpassInterpolation<T>;
+
+    // the loop applies the gain once a period, so over t60 seconds it is applied
+    // t60 / period times, and that many applications should come to -60 dB
+    static T loop_gain(T t60, T period)
+    {
+        int k = std::max(1, int(t60 / period));
+        return pow(dbtoa(-60.0), 1.0f / k);
+    }
+
+    void run(Group &g, Frame *line, T *out, int n)
     {
-        float v = filter(delay.read(delayTime, sampleRate)) * gain;
-        delay.write(v);
-        return v;
+        for (int l = 0; l < lanes; ++l)
+        {
+            T y1 = g.y1[l], x1 = g.x1[l], peak = g.peak[l];
+            const T eta = g.eta[l], gain = g.gain[l];
+            const size_t i = g.offset[l];
+            for (int k = 0; k < n; ++k)
+            {
+                size_t at = now + k;
+                T x = Allpass::step(eta, line[(at - i) & mask].lane[l], line[(at - i - 1) & mask].lane[l], y1);
+                T v = (x + x1) / 2 * gain;
+                y1 = x;
+                x1 = x;
+                line[at & mask].lane[l] = v;
+                peak = std::max(peak, std::abs(v));
+                out[k] += v;
+            }
+            g.y1[l] = y1;
+            g.x1[l] = x1;
+            g.peak[l] = peak;
+        }
+    }
+
+    void run_f4(Group &g, Frame *line, f4 *mix, int n)
+    {
+        const f4 eta = f4::load(g.eta), gain = f4::load(g.gain), half = f4::set(0.5f), zero = f4::set(0.f);
+        f4 y1 = f4::load(g.y1), x1 = f4::load(g.x1), peak = f4::load(g.peak);
+
+        // lane l reads x0 at now + k - offset and x1 one frame before it, which is
+        // the previous sample's x0, so each sample loads one new frame per lane.
+        // from[l] is the frame of the first x1
+        size_t from[lanes];
+        bool wraps = (now & mask) + n > mask + 1;
+        for (int l = 0; l < lanes; ++l)
+        {
+            from[l] = (now - g.offset[l] - 1) & mask;
+            wraps |= from[l] + n + 1 > mask + 1;
+        }
+
+        // the one step every path runs, x0 in and the sample for frame now + k out
+        auto tick = [&](int k, f4 x0, f4 &previous)
+        {
+            f4 x = Allpass::step(eta, x0, previous, y1);
+            previous = x0;
+            f4 y = (x + x1) * half * gain;
+            y1 = x;
+            x1 = x;
+            y.store(line[(now + k) & mask].lane);
+            peak = max(peak, max(y, zero - y));
+            mix[k] = mix[k] + y;
+        };
+
+        if (!wraps)
+        {
+            // no read or write of this chunk crosses the end of the line, so every
+            // lane walks along it through a plain pointer, a frame per sample,
+            // with no index arithmetic in the loop
+            const float *r0 = &line[from[0]].lane[0], *r1 = &line[from[1]].lane[1];
+            const float *r2 = &line[from[2]].lane[2], *r3 = &line[from[3]].lane[3];
+            alignas(16) float a[lanes] = {r0[0], r1[0], r2[0], r3[0]};
+            f4 previous = f4::load(a);
+            for (int k = 0; k < n; ++k)
+            {
+                const int j = lanes * (k + 1);
+                alignas(16) float b[lanes] = {r0[j], r1[j], r2[j], r3[j]};
+                tick(k, f4::load(b), previous);
+            }
+        }
+        else
+        {
+            // the gather, spelled out so it is four plain loads at any optimization level
+            alignas(16) float a[lanes] = {line[from[0]].lane[0], line[from[1]].lane[1],
+                                          line[from[2]].lane[2], line[from[3]].lane[3]};
+            f4 previous = f4::load(a);
+            for (int k = 0; k < n; ++k)
+            {
+                alignas(16) float b[lanes] = {line[(from[0] + k + 1) & mask].lane[0], line[(from[1] + k + 1) & mask].lane[1],
+                                              line[(from[2] + k + 1) & mask].lane[2], line[(from[3] + k + 1) & mask].lane[3]};
+                tick(k, f4::load(b), previous);
+            }
+        }
+        y1.store(g.y1);
+        x1.store(g.x1);
+        peak.store(g.peak);
+    }
+};
+
+// a fixed pool of strings played by MIDI notes, all allocated in prepare().
+// voice v is string v of the bank, so voices fill the low groups first.
+// a note takes a free voice, else the quietest released one, else the oldest
+// held one. note-off damps the string rather than cutting it, and a voice
+// whose peak over a block falls below `silence` goes back to the pool, so the
+// cost follows what is audible and never passes max_voices strings a sample.
+template <typename T>
+class StringVoices
+{
+public:
+    static constexpr int max_voices = 64;
+    static constexpr T silence = T(3e-5);   // about -90 dB
+    static constexpr T release = T(0.15);   // decay time after note-off, seconds
+
+    // not the audio thread
+    void prepare(T samplerate, T lowest_hertz)
+    {
+        bank.prepare(max_voices, samplerate, lowest_hertz);
+        voices.resize(max_voices);
+        for (auto &voice : voices)
+            voice.sounding = voice.held = false;
+        count = 0;
+    }
+
+    // note -1 is not a key, it only ends by decaying
+    void note_on(int note, T hertz, T amplitude, T seconds)
+    {
+        if (voices.empty())
+            return;
+        int v = find(note);
+        if (v < 0)
+            v = count < max_voices ? free_voice() : steal();
+        Voice &voice = voices[v];
+        if (!voice.sounding)
+        {
+            voice.sounding = true;
+            active[count++] = v;
+        }
+        voice.note = note;
+        voice.held = note >= 0;
+        voice.started = ++clock;
+        voice.level = amplitude;
+        bank.configure(v, hertz, seconds);
+        bank.trigger(v, amplitude);
+    }
+
+    void note_off(int note)
+    {
+        int v = find(note);
+        if (v < 0)
+            return;
+        voices[v].held = false;
+        bank.damp(v, release);
+    }
+
+    void all_notes_off()
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            voices[active[i]].held = false;
+            bank.damp(active[i], release);
+        }
+    }
+
+    // the sum of every sounding string into out[0, n); split blocks at the notes
+    void render(T *out, int n)
+    {
+        bank.render(out, n);
+    }
+
+    // once per block, after the samples: frees the voices that went silent
+    void cull()
+    {
+        for (int i = 0; i < count;)
+        {
+            Voice &voice = voices[active[i]];
+            voice.level = bank.take_peak(active[i]);
+            if (voice.level < silence)
+            {
+                bank.stop(active[i]);
+                voice.sounding = voice.held = false;
+                active[i] = active[--count];
+            }
+            else
+                ++i;
+        }
+    }
+
+    int sounding() const { return count; }
+
+private:
+    struct Voice
+    {
+        int note = -1;
+        bool held = false;
+        bool sounding = false;
+        uint64_t started = 0; // when it was plucked, by note count
+        T level = 0;          // peak over the last block, for stealing
+    };
+
+    StringBank<T> bank;
+    std::vector<Voice> voices;
+    int active[max_voices]; // indices of the sounding voices, [0, count)
+    int count = 0;
+    uint64_t clock = 0;
+
+    // the sounding voice playing this key, a retrigger reuses it
+    int find(int note) const
+    {
+        if (note < 0)
+            return -1;
+        for (int i = 0; i < count; ++i)
+            if (voices[active[i]].note == note && voices[active[i]].sounding)
+                return active[i];
+        return -1;
+    }
+
+    int free_voice() const
+    {
+        for (int v = 0; v < max_voices; ++v)
+            if (!voices[v].sounding)
+                return v;
+        return 0;
+    }
+
+    // all voices sound: the quietest released one, else the oldest
+    int steal() const
+    {
+        int quietest = -1, oldest = active[0];
+        for (int i = 0; i < count; ++i)
+        {
+            const Voice &voice = voices[active[i]];
+            if (!voice.held && (quietest < 0 || voice.level < voices[quietest].level))
+                quietest = active[i];
+            if (voice.started < voices[oldest].started)
+                oldest = active[i];
+        }
+        return quietest >= 0 ? quietest : oldest;
     }
-    // XXX put code here
 };
 
 using namespace juce;
@@ -227,9 +540,14 @@ class KarplusStrong : public AudioProcessor
     AudioParameterFloat *note;
     AudioParameterFloat *time;
     AudioParameterFloat *freq;
+    AudioParameterBool *autopluck;
     BooleanOscillator timer;
-    MassSpringModel string;
-    KarplusStrongModel karplus;
+    MassSpringModel<float> string;
+    // one pool per precision, the host runs one or the other
+    StringVoices<float> strings;
+    StringVoices<double> strings_double;
+    StringVoices<float> &voices(float) { return strings; }
+    StringVoices<double> &voices(double) { return strings_double; }
     /// add parameters here ///////////////////////////////////////////////////
 
 public:
@@ -250,6 +568,8 @@ public:
         addParameter(
             freq = new AudioParameterFloat(
                 {"playback frequency", 1}, "playback frequency", NormalisableRange<float>(0.1, 10.0, 0.1f), 1.0));
+        addParameter(
+            autopluck = new AudioParameterBool({"autopluck", 1}, "Auto pluck", true));
         /// add parameters here /////////////////////////////////////////////
 
         // XXX juce::getSampleRate() is not valid here
@@ -258,35 +578,84 @@ public:
     float previous = 0;
 
     /// handling the actual audio! ////////////////////////////////////////////
-    void processBlock(AudioBuffer<float> &buffer, MidiBuffer &) override
+    void processBlock(AudioBuffer<float> &buffer, MidiBuffer &midi) override
+    {
+        process(buffer, midi);
+    }
+
+    /// handle doubles ////////////////////////////////////////////////////////
+    void processBlock(AudioBuffer<double> &buffer, MidiBuffer &midi) override
     {
-        buffer.clear(0, 0, buffer.getNumSamples());
+        process(buffer, midi);
+    }
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+
+    template <typename Sample>
+    void process(AudioBuffer<Sample> &buffer, MidiBuffer &midi)
+    {
+        RealtimeScope realtime;
+        auto &pool = voices(Sample());
+        Sample level = dbtoa((Sample)gain->get());
+        Sample seconds = (Sample)time->get();
+        // the pool is mono: render channel 0 once, then copy it to the others
         auto left = buffer.getWritePointer(0, 0);
-        auto right = buffer.getWritePointer(1, 0);
-        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        auto event = midi.cbegin();
+        int n = buffer.getNumSamples();
+        for (int i = 0; i < n;)
         {
-
-            if (timer())
+            // notes start on the sample they were sent for
+            for (; event != midi.cend() && (*event).samplePosition <= i; ++event)
             {
-                timer.period(freq->get(), (float)getSampleRate());
-                karplus.configure(mtof(note->get()), time->get(), (float)getSampleRate());
-                karplus.trigger();
+                handle((*event).getMessage(), pool, seconds);
             }
+            int end = event != midi.cend() ? std::min((*event).samplePosition, n) : n;
 
-            left[i] = right[i] = karplus() * dbtoa(gain->get());
-            ;
+            for (int j = i; j < end; ++j)
+            {
+                if (timer() && autopluck->get())
+                {
+                    pool.render(left + i, j - i);
+                    i = j;
+                    timer.period(freq->get(), (float)getSampleRate());
+                    pool.note_on(-1, mtof((Sample)note->get()), 1, seconds);
+                }
+            }
+            pool.render(left + i, end - i);
+            i = end;
+        }
+        pool.cull();
+        buffer.applyGain(0, 0, n, level);
+        for (int ch = 1; ch < buffer.getNumChannels(); ++ch)
+        {
+            buffer.copyFrom(ch, 0, buffer, 0, 0, buffer.getNumSamples());
         }
     }
 
-    /// handle doubles ? //////////////////////////////////////////////////////
-    // void processBlock(AudioBuffer<double>& buffer, MidiBuffer&) override {
-    //   buffer.applyGain(dbtoa((float)*gain));
-    // }
+    template <typename Sample>
+    void handle(const MidiMessage &message, StringVoices<Sample> &pool, Sample seconds)
+    {
+        if (message.isNoteOn())
+        {
+            int key = message.getNoteNumber();
+            pool.note_on(key, mtof((Sample)key), (Sample)message.getFloatVelocity(), seconds);
+        }
+        else if (message.isNoteOff())
+            pool.note_off(message.getNoteNumber());
+        else if (message.isAllNotesOff() || message.isAllSoundOff())
+            pool.all_notes_off();
+    }
 
     /// start and shutdown callbacks///////////////////////////////////////////
-    void prepareToPlay(double, int) override
+    void prepareToPlay(double sampleRate, int) override
     {
         // XXX when does this get called? seems to not get called in stand-alone
+        // the pool allocates, so only the precision the host is going to run;
+        // MIDI note 0 is above the lowest note the parameter reaches
+        float lowest = mtof(note->getNormalisableRange().start);
+        if (isUsingDoublePrecision())
+            strings_double.prepare(sampleRate, lowest);
+        else
+            strings.prepare((float)sampleRate, lowest);
     }
     void releaseResources() override {}
 
@@ -1,20 +1,22 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <stdio.h>
 #include "utility.hpp"
+#include "../common/realtime_guard.hpp"
 
 // https://en.wikipedia.org/wiki/Harmonic_oscillator
+template <typename T>
 struct MassSpringModel
 {
     // this the whole state of the simulation
     //
-    float position{0}; // m
-    float velocity{0}; // m/s
+    T position{0}; // m
+    T velocity{0}; // m/s
 
     // These are cached properties of the model; They govern the behaviour. We
     // recalculate them given frequency, decay time, and playback rate.
     //
-    float springConstant{0};     // N/m
-    float dampingCoefficient{0}; // N·s/m
+    T springConstant{0};     // N/m
+    T dampingCoefficient{0}; // N·s/m
 
     void show()
     {
@@ -28,7 +30,7 @@ struct MassSpringModel
         position = velocity = 0;
     }
 
-    float next_sample()
+    T next_sample()
     {
         // This is semi-implicit Euler integration with time-step 1. The
         // playback rate is "baked into" the constants. Spring force and damping
@@ -36,7 +38,7 @@ struct MassSpringModel
         // disappears. Velocity is accumulated into position which is
         // interpreted as oscillator amplitude.
         //
-        float acceleration = 0;
+        T acceleration = 0;
 
         acceleration = -position * springConstant - dampingCoefficient * velocity;
 
@@ -53,16 +55,16 @@ struct MassSpringModel
         return position;
     }
 
-    float operator()()
+    T operator()()
     {
         return next_sample();
     }
 
     // Use these to measure the kinetic, potential, and total energy of the
     // system.
-    float ke() { return velocity * velocity / 2; }
-    float pe() { return position * position * springConstant / 2; }
-    float te() { return ke() + pe(); }
+    T ke() { return velocity * velocity / 2; }
+    T pe() { return position * position * springConstant / 2; }
+    T te() { return ke() + pe(); }
 
     // "Kick" the mass-spring system such that we get a nice (-1, 1) oscillation.
     //
@@ -83,7 +85,7 @@ struct MassSpringModel
         // depending on frequency according to the Fletcher-Munson curves.
     }
 
-    void recalculate(float frequency, float decayTime, float playbackRate)
+    void recalculate(T frequency, T decayTime, T playbackRate)
     {
 
         // frequency equals to 2pi/(sqrt(1-ksi^2)*w0)
@@ -111,7 +113,10 @@ struct SpringSynth : public AudioProcessor
 {
     AudioParameterFloat *frequency;
     AudioParameterFloat *decayTime;
-    std::unique_ptr<MassSpringModel> _springModel = std::make_unique<MassSpringModel>();
+    std::unique_ptr<MassSpringModel<float>> _springModel = std::make_unique<MassSpringModel<float>>();
+    std::unique_ptr<MassSpringModel<double>> _springModelDouble = std::make_unique<MassSpringModel<double>>();
+    MassSpringModel<float> &model(float) { return *_springModel; }
+    MassSpringModel<double> &model(double) { return *_springModelDouble; }
     bool current_state = true;
     /// add parameters here ///////////////////////////////////////////////////
     /// add your objects here /////////////////////////////////////////////////
@@ -132,14 +137,28 @@ struct SpringSynth : public AudioProcessor
     /// this function handles the audio ///////////////////////////////////////
     void processBlock(AudioBuffer<float> &buffer, MidiBuffer &) override
     {
+        process(buffer);
+    }
+
+    void processBlock(AudioBuffer<double> &buffer, MidiBuffer &) override
+    {
+        process(buffer);
+    }
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+
+    template <typename Sample>
+    void process(AudioBuffer<Sample> &buffer)
+    {
+        RealtimeScope realtime;
         // buffer.clear(0, 0, buffer.getNumSamples());
         auto left = buffer.getWritePointer(0, 0);
         auto right = buffer.getWritePointer(1, 0);
+        auto &spring = model(Sample());
 
         for (int i = 0; i < buffer.getNumSamples(); ++i)
         {
-            _springModel->recalculate(frequency->get(), decayTime->get(), (float)getSampleRate());
-            left[i] = right[i] = _springModel->next_sample();
+            spring.recalculate(frequency->get(), decayTime->get(), (Sample)getSampleRate());
+            left[i] = right[i] = spring.next_sample();
         }
     }
 
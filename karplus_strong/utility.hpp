@@ -1,5 +1,6 @@
 #include <cmath>
 #include <iostream>
+#include "../common/xoshiro.hpp"
 
 template <typename T>
 T mtof(T m)
@@ -57,14 +58,3 @@ inline T wrap(T v, T hi, T lo)
     }
     return v;
 }
-
-struct MeanFilter
-{
-    float x1{0};
-    float operator()(float x0)
-    {
-        float mean = (x0 + x1) / 2;
-        x1 = x0;
-        return mean;
-    }
-};
\ No newline at end of file
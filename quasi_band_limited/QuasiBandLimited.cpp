@@ -7,6 +7,7 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "QuasiFM.hpp"
 #include "utility.hpp"
+#include "../common/realtime_guard.hpp"
 
 using namespace juce;
 
@@ -46,12 +47,27 @@ struct QuasiBandLimited : public AudioProcessor
   /// this function handles the audio ///////////////////////////////////////
   void processBlock(AudioBuffer<float> &buffer, MidiBuffer &) override
   {
+    process(buffer);
+  }
+
+  // the oscillators run in float either way, a double host just gets them
+  // written straight into its buffer instead of through a conversion pass
+  void processBlock(AudioBuffer<double> &buffer, MidiBuffer &) override
+  {
+    process(buffer);
+  }
+  bool supportsDoublePrecisionProcessing() const override { return true; }
+
+  template <typename Sample>
+  void process(AudioBuffer<Sample> &buffer)
+  {
+    RealtimeScope realtime;
     /// put your own code here instead of this code /////////////////////////
     // buffer.clear(0, 0, buffer.getNumSamples());
     // buffer.clear(1, 0, buffer.getNumSamples());
+    // the oscillators are mono: render channel 0 once, then copy it to the others
     auto left = buffer.getWritePointer(0, 0);
-    auto right = buffer.getWritePointer(1, 0);
-    // left[0] = right[0] = dbtoa(gain->get()); // click!
+    // left[0] = dbtoa(gain->get()); // click!
 
     for (int i = 0; i < buffer.getNumSamples(); ++i)
     {
@@ -64,7 +80,11 @@ struct QuasiBandLimited : public AudioProcessor
       float index = dbtoa(depth->get());
 
       auto res = A * cycle->next_sample(alpha + index * soft_clip(modulator->next_sample(beta)));
-      left[i] = right[i] = res;
+      left[i] = res;
+    }
+    for (int ch = 1; ch < buffer.getNumChannels(); ++ch)
+    {
+      buffer.copyFrom(ch, 0, buffer, 0, 0, buffer.getNumSamples());
     }
   }
 
@@ -125,4 +145,4 @@ private:
 AudioProcessor *JUCE_CALLTYPE createPluginFilter()
 {
   return new QuasiBandLimited();
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include "../common/capture_tap.hpp"
 
 #define pi 3.1415926
 
@@ -17,19 +18,21 @@ protected:
     float w = 0.f;             // normalized frequency
     float scaling = 0.f;       // scaling amount
     float DC = 0.f;            // DC compensation
-    std::vector<float> result; // results
+    CaptureTap capture;        // optional recording of the output
     float pw = 0.5;            // pulse width of the pulse, 0..1
     float norm = 0.f;          // normalization amount
     float const a0 = 2.5f;     // precalculated coeffs
     float const a1 = -1.5f;    // for HF compensation
     float in_hist = 0.f;       // delay for the HF filter
     float virtual_filter_param = 0.9f;
+    float sample_rate = 44100.f;      // last rate passed to configure, used for the capture file
 
 public:
     // calculate w and scaling
 
     void configure(float freq, float sample_rate = 44100)
     {
+        this->sample_rate = sample_rate;
         w = freq / sample_rate; // normalized frequency
         float n = 0.5f - w;
         scaling = virtual_filter_param * 13.0f * n * n * n * n; // calculate scaling
@@ -41,21 +44,16 @@ public:
 
     virtual float next_sample() = 0;
 
-    void clear_result()
+    // records everything next_sample() produces into a float WAV until stop_capture()
+    // call these from the message thread, next_sample() stays allocation free either way
+    void start_capture(std::string filename)
     {
-        result.clear();
+        capture.start(filename, (int)sample_rate);
     }
 
-    void write_to_file(std::string filename)
+    void stop_capture()
     {
-        std::ofstream _file;
-        _file.open(filename);
-        for (const auto &out : result)
-        {
-            _file << out << std::endl;
-        }
-
-        _file.close();
+        capture.stop();
     }
 
     float operator()()
@@ -84,7 +82,7 @@ public:
         // compensate HF rolloff
         out = a0 * out + a1 * in_hist;
         in_hist = osc - osc2;         // input history
-        result.push_back(out * norm); // store normalized result
+        capture.push(out * norm);     // store normalized result
         return out * norm;
     }
 };
@@ -106,7 +104,7 @@ public:
         float out = a0 * osc + a1 * in_hist;
         in_hist = osc;
         out = out + DC;
-        result.push_back(out * norm);
+        capture.push(out * norm);
         return out * norm;
     }
 };
\ No newline at end of file
@@ -7,16 +7,20 @@
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "QuasiFM.hpp"
 #include "utility.hpp"
+#include "../common/realtime_guard.hpp"
 
 using namespace juce;
 
 // http://scp.web.elte.hu/papers/synthesis1.pdf
 
-struct QuasiBandImpulse : public AudioProcessor
+struct QuasiBandImpulse : public AudioProcessor,
+                          private AudioProcessorParameter::Listener,
+                          private AsyncUpdater
 {
     AudioParameterFloat *note;
     AudioParameterFloat *scale;
     AudioParameterBool *mode;
+    AudioParameterBool *capture;
     std::unique_ptr<QuasiImpulse> _qimp = std::make_unique<QuasiImpulse>();
     std::unique_ptr<QuasiSaw> _qsaw = std::make_unique<QuasiSaw>();
 
@@ -35,12 +39,53 @@ struct QuasiBandImpulse : public AudioProcessor
                          {"scale", 1}, "scale",
                          NormalisableRange<float>(-10, 10, 0.1f), 1));
         addParameter(mode = new AudioParameterBool({"mode", 2}, "mode", false));
+        addParameter(capture = new AudioParameterBool({"capture", 1}, "capture", false));
+        capture->addListener(this);
+    }
+
+    ~QuasiBandImpulse() override
+    {
+        capture->removeListener(this);
+        cancelPendingUpdate();
+    }
+
+    // hosts may call this from the audio thread, the capture thread is started on the message thread
+    void parameterValueChanged(int, float) override { triggerAsyncUpdate(); }
+    void parameterGestureChanged(int, bool) override {}
+
+    // both oscillators record to their own file in the documents folder, only the one playing fills it
+    void handleAsyncUpdate() override
+    {
+        if (capture->get())
+        {
+            auto folder = File::getSpecialLocation(File::userDocumentsDirectory);
+            _qimp->start_capture(folder.getChildFile("quasi_impulse.wav").getFullPathName().toStdString());
+            _qsaw->start_capture(folder.getChildFile("quasi_saw.wav").getFullPathName().toStdString());
+        }
+        else
+        {
+            _qimp->stop_capture();
+            _qsaw->stop_capture();
+        }
     }
 
     /// this function handles the audio ///////////////////////////////////////
     void processBlock(AudioBuffer<float> &buffer, MidiBuffer &) override
     {
+        process(buffer);
+    }
+
+    // the saw and the pulse stay float inside, only their output is widened
+    void processBlock(AudioBuffer<double> &buffer, MidiBuffer &) override
+    {
+        process(buffer);
+    }
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
+    template <typename Sample>
+    void process(AudioBuffer<Sample> &buffer)
+    {
+        RealtimeScope realtime;
         auto left = buffer.getWritePointer(0, 0);
         auto right = buffer.getWritePointer(1, 0);
         _qimp->configure(mtof(note->get()));
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#define REALTIME_GUARD 1
+#include "../common/realtime_guard.hpp"
+using namespace std;
+
+// a host for common/realtime_guard.hpp: runs code that is and is not real-time
+// safe inside a RealtimeScope and checks what RealtimeGuard::violations()
+// counted, then reruns itself with REALTIME_GUARD_ABORT=1 and checks that the
+// first violation kills it with SIGABRT. returns 1 if anything is off.
+// linux only, like the hooks it checks.
+//
+// build: g++ -std=c++17 -O2 -rdynamic -o realtime_guard_check realtime_guard_check/main.cpp -ldl -lpthread
+
+// through a volatile pointer so the optimizer cannot drop the allocation
+void *(*volatile allocate)(size_t) = std::malloc;
+void (*volatile release)(void *) = std::free;
+volatile float sink;
+
+int failures = 0;
+
+// counts what `audio` does inside a scope; none of the printing happens in there
+template <typename Audio>
+void check(const char *what, bool expect_violation, Audio &&audio)
+{
+    RealtimeGuard::reset();
+    {
+        RealtimeScope realtime;
+        audio();
+    }
+    uint64_t count = RealtimeGuard::violations();
+    bool ok = (count > 0) == expect_violation;
+    failures += !ok;
+    printf("%-36s %llu violation(s)%s\n", what, (unsigned long long)count, ok ? "" : "  FAIL");
+}
+
+// the child: one allocation on the "audio thread", which should not return
+int abort_child()
+{
+    RealtimeScope realtime;
+    void *pointer = allocate(64);
+    release(pointer);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--abort-child") == 0)
+        return abort_child();
+
+    vector<float> buffer(4096);
+    mutex lock;
+
+    check("preallocated buffer", false, [&]
+          {
+              for (size_t i = 0; i < buffer.size(); i++)
+                  buffer[i] = buffer[i] * 0.5f + 1.f;
+              sink = buffer[17];
+          });
+    check("malloc", true, []
+          { release(allocate(64)); });
+    check("std::vector", true, []
+          {
+              vector<float> temporary(256, 1.f);
+              sink = temporary[3];
+          });
+    check("std::mutex", true, [&]
+          {
+              lock.lock();
+              lock.unlock();
+          });
+    check("sleep_for", true, []
+          { this_thread::sleep_for(chrono::microseconds(10)); });
+    check("nested scopes", true, []
+          {
+              RealtimeScope inner;
+              release(allocate(64));
+          });
+
+    // outside every scope nothing counts
+    RealtimeGuard::reset();
+    release(allocate(64));
+    lock.lock();
+    lock.unlock();
+    bool quiet = RealtimeGuard::violations() == 0;
+    failures += !quiet;
+    printf("%-36s %s\n", "outside a scope", quiet ? "0 violation(s)" : "counted, FAIL");
+
+    // REALTIME_GUARD_ABORT is read once per process, so the abort runs in a fresh one
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        setenv("REALTIME_GUARD_ABORT", "1", 1);
+        // the child's report goes to stderr, which is what a failing test run shows
+        execl("/proc/self/exe", argv[0], "--abort-child", (char *)nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    bool aborted = WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+    failures += !aborted;
+    printf("%-36s %s\n", "REALTIME_GUARD_ABORT=1", aborted ? "aborted" : "did not abort, FAIL");
+
+    // nothing left for the report at exit
+    RealtimeGuard::reset();
+    if (failures)
+        printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}